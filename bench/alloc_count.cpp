@@ -0,0 +1,68 @@
+//
+// Created by hlx on 2023/10/4.
+//
+
+// 用LD_PRELOAD载入 统计进程的堆分配次数 退出时写到LOX_ALLOC_COUNT_FILE指定的文件
+// 转发给glibc导出的__libc_*分配函数 不需要dlsym
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *pointer, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+}
+
+// 常量初始化 在任何分配之前就可用
+static std::atomic<unsigned long long> allocations(0);
+
+static inline void count() {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+extern "C" void *malloc(size_t size) {
+    count();
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t number, size_t size) {
+    count();
+    return __libc_calloc(number, size);
+}
+
+// 原地缩放也计一次 与分配器的调用次数一致
+extern "C" void *realloc(void *pointer, size_t size) {
+    count();
+    return __libc_realloc(pointer, size);
+}
+
+extern "C" void *aligned_alloc(size_t alignment, size_t size) {
+    count();
+    return __libc_memalign(alignment, size);
+}
+
+extern "C" void *memalign(size_t alignment, size_t size) {
+    count();
+    return __libc_memalign(alignment, size);
+}
+
+extern "C" int posix_memalign(void **pointer, size_t alignment, size_t size) {
+    count();
+    void *result = __libc_memalign(alignment, size);
+    if (result == nullptr) return ENOMEM;
+    *pointer = result;
+    return 0;
+}
+
+__attribute__((destructor)) static void report() {
+    const char *path = getenv("LOX_ALLOC_COUNT_FILE");
+    if (path == nullptr) return;
+    unsigned long long total = allocations.load();
+    FILE *file = fopen(path, "w");
+    if (file == nullptr) return;
+    fprintf(file, "%llu\n", total);
+    fclose(file);
+}
@@ -0,0 +1,155 @@
+#!/usr/bin/env python3
+#
+# Created by hlx on 2023/10/4.
+#
+# 用两个解释器运行基准程序 每个程序重复多次 输出中位时间 峰值内存和堆分配次数
+# 结果为JSON 每个(程序, 解释器)一项 同时在标准错误输出一张表
+# 加--register时虚拟机再分别以不开JIT的栈式解释器(vm --no-jit)和寄存器层(vm --register)运行 两者对比
+#
+#   run.py --vm build/vm --tree-walk build/tree-walk [--register] [--alloc-lib build/liballoc_count.so]
+#          [--repeat 5] [--timeout 120] [--output bench.json] [name...]
+
+import argparse
+import json
+import os
+import signal
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+BENCH_DIR = os.path.dirname(os.path.abspath(__file__))
+
+# 经典的Lox基准程序
+BENCHMARKS = [
+    "fib",
+    "binary_trees",
+    "method_call",
+    "instantiation",
+    "string_equality",
+    "zoo",
+    "trees",
+    "equality",
+    "properties",
+    "arithmetic",
+]
+
+
+def run_once(command, script, alloc_lib, timeout):
+    """运行一次 返回(退出码, 墙钟秒数, 峰值RSS KB, 分配次数) 超时退出码为None"""
+    env = dict(os.environ)
+    count_path = None
+    if alloc_lib:
+        handle, count_path = tempfile.mkstemp(prefix="lox-alloc-")
+        os.close(handle)
+        env["LD_PRELOAD"] = alloc_lib
+        env["LOX_ALLOC_COUNT_FILE"] = count_path
+
+    start = time.perf_counter()
+    process = subprocess.Popen(command + [script], stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL, env=env)
+    deadline = start + timeout
+    # 用wait4取得这个子进程自己的rusage
+    while True:
+        pid, status, usage = os.wait4(process.pid, os.WNOHANG)
+        if pid != 0:
+            break
+        if time.perf_counter() > deadline:
+            process.send_signal(signal.SIGKILL)
+            os.wait4(process.pid, 0)
+            process.returncode = -signal.SIGKILL
+            if count_path:
+                os.unlink(count_path)
+            return None, timeout, None, None
+        time.sleep(0.001)
+    elapsed = time.perf_counter() - start
+    process.returncode = os.waitstatus_to_exitcode(status)
+
+    allocations = None
+    if count_path:
+        try:
+            with open(count_path) as file:
+                allocations = int(file.read().strip() or 0)
+        except (OSError, ValueError):
+            allocations = None
+        os.unlink(count_path)
+    return process.returncode, elapsed, usage.ru_maxrss, allocations
+
+
+def run_benchmark(name, interpreter, command, args):
+    script = os.path.join(BENCH_DIR, name + ".lox")
+    times, rss, allocations = [], [], []
+    exit_code = 0
+    for _ in range(args.repeat):
+        code, elapsed, peak, count = run_once(command, script, args.alloc_lib, args.timeout)
+        if code != 0:
+            exit_code = code
+            break
+        times.append(elapsed)
+        rss.append(peak)
+        if count is not None:
+            allocations.append(count)
+
+    return {
+        "benchmark": name,
+        "interpreter": interpreter,
+        "runs": len(times),
+        "exit_code": exit_code,
+        "median_seconds": round(statistics.median(times), 6) if times else None,
+        "min_seconds": round(min(times), 6) if times else None,
+        "peak_rss_kb": max(rss) if rss else None,
+        "allocations": int(statistics.median(allocations)) if allocations else None,
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Run the Lox benchmarks against both interpreters.")
+    parser.add_argument("--vm", help="bytecode vm executable")
+    parser.add_argument("--tree-walk", help="tree-walk interpreter executable")
+    parser.add_argument("--register", action="store_true",
+                        help="also run the vm as a plain stack interpreter (--no-jit) and with its register tier")
+    parser.add_argument("--alloc-lib", help="LD_PRELOAD library that counts heap allocations")
+    parser.add_argument("--repeat", type=int, default=5, help="runs per benchmark (default 5)")
+    parser.add_argument("--timeout", type=float, default=120, help="seconds before a run is killed (default 120)")
+    parser.add_argument("--output", help="write the JSON results here instead of stdout")
+    parser.add_argument("names", nargs="*", help="benchmarks to run (default all)")
+    args = parser.parse_args()
+
+    interpreters = [(name, [path]) for name, path in (("vm", args.vm), ("tree-walk", args.tree_walk)) if path]
+    if not interpreters:
+        parser.error("give --vm and/or --tree-walk")
+    if args.register:
+        if not args.vm:
+            parser.error("--register needs --vm")
+        interpreters[1:1] = [("vm-stack", [args.vm, "--no-jit"]), ("vm-reg", [args.vm, "--register"])]
+    names = args.names or BENCHMARKS
+    for name in names:
+        if not os.path.exists(os.path.join(BENCH_DIR, name + ".lox")):
+            parser.error("unknown benchmark " + name)
+
+    results = []
+    sys.stderr.write("%-16s %-10s %12s %12s %12s\n" % ("benchmark", "interp", "median s", "peak KB", "allocs"))
+    for name in names:
+        for interpreter, command in interpreters:
+            result = run_benchmark(name, interpreter, command, args)
+            results.append(result)
+            if result["exit_code"] != 0:
+                status = "timeout" if result["exit_code"] is None else "exit %d" % result["exit_code"]
+                sys.stderr.write("%-16s %-10s %12s\n" % (name, interpreter, status))
+            else:
+                sys.stderr.write("%-16s %-10s %12.4f %12d %12s\n" % (
+                    name, interpreter, result["median_seconds"], result["peak_rss_kb"],
+                    "-" if result["allocations"] is None else result["allocations"]))
+            sys.stderr.flush()
+
+    text = json.dumps({"repeat": args.repeat, "results": results}, indent=2)
+    if args.output:
+        with open(args.output, "w") as file:
+            file.write(text + "\n")
+    else:
+        print(text)
+    return 1 if any(result["exit_code"] != 0 for result in results) else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
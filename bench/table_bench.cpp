@@ -0,0 +1,113 @@
+//
+// Created by hlx on 2023/10/4.
+//
+
+// Table 与原先基于 std::unordered_map 的表的插入/查找吞吐对比
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "object.h"
+#include "vm.h"
+
+using namespace cpplox;
+
+// 原先的容器 每次哈希都重新遍历字符串内容
+struct StringHash {
+    size_t operator()(const ObjString *x) const {
+        uint32_t hash = 2166136261u;
+        for (int i = 0; i < x->length; i++) {
+            hash ^= (uint8_t) x->chars[i];
+            hash *= 16777619;
+        }
+        return hash;
+    }
+};
+
+struct StringEqual {
+    bool operator()(const ObjString *x, const ObjString *y) const {
+        return x->length == y->length && memcmp(x->chars, y->chars, x->length) == 0;
+    }
+};
+
+using MapTable = std::unordered_map<ObjString *, Value, StringHash, StringEqual>;
+
+// 返回每秒操作数(百万)
+template<typename F>
+static double measure(int ops, F body) {
+    auto start = std::chrono::steady_clock::now();
+    body();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return ops / elapsed.count() / 1e6;
+}
+
+int main(int argc, const char *argv[]) {
+    int keyCount = argc > 1 ? atoi(argv[1]) : 1000;
+    int rounds = argc > 2 ? atoi(argv[2]) : 2000;
+
+    VM machine;
+    initVM(&machine);
+    // 键只由这里持有 基准期间不做gc
+    vm->nextGC = SIZE_MAX;
+
+    std::vector<ObjString *> keys;
+    for (int i = 0; i < keyCount; i++) {
+        std::string name = "field_name_" + std::to_string(i);
+        keys.push_back(copyString(name.data(), (int) name.size()));
+    }
+
+    int inserts = keyCount * (rounds / 10 + 1);
+    int lookups = keyCount * rounds;
+    double sink = 0;
+
+    double tableInsert = measure(inserts, [&] {
+        for (int r = 0; r < rounds / 10 + 1; r++) {
+            Table table;
+            for (int i = 0; i < keyCount; i++) table.set(keys[i], NUMBER_VAL((double) i));
+        }
+    });
+    double mapInsert = measure(inserts, [&] {
+        for (int r = 0; r < rounds / 10 + 1; r++) {
+            MapTable table;
+            for (int i = 0; i < keyCount; i++) table[keys[i]] = NUMBER_VAL((double) i);
+        }
+    });
+
+    Table table;
+    MapTable map;
+    for (int i = 0; i < keyCount; i++) {
+        table.set(keys[i], NUMBER_VAL((double) i));
+        map[keys[i]] = NUMBER_VAL((double) i);
+    }
+
+    double tableLookup = measure(lookups, [&] {
+        for (int r = 0; r < rounds; r++) {
+            for (int i = 0; i < keyCount; i++) {
+                Value value;
+                if (table.get(keys[i], &value)) sink += AS_NUMBER(value);
+            }
+        }
+    });
+    double mapLookup = measure(lookups, [&] {
+        for (int r = 0; r < rounds; r++) {
+            for (int i = 0; i < keyCount; i++) {
+                auto iter = map.find(keys[i]);
+                if (iter != map.end()) sink += AS_NUMBER(iter->second);
+            }
+        }
+    });
+
+    printf("keys %d  (Mops/s)\n", keyCount);
+    printf("%-16s %10s %10s\n", "", "insert", "lookup");
+    printf("%-16s %10.2f %10.2f\n", "Table", tableInsert, tableLookup);
+    printf("%-16s %10.2f %10.2f\n", "unordered_map", mapInsert, mapLookup);
+    printf("checksum %.0f\n", sink);
+
+    freeVM(&machine);
+    return 0;
+}
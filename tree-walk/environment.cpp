@@ -40,7 +40,11 @@ namespace cpplox {
     }
 
     void Environment::define(std::string name, Object *value) {
-        values[name] = value;
+        if (enclosing == nullptr) {
+            values[name] = value;
+        } else {
+            slots.push_back(value);
+        }
     }
 
     Environment *Environment::ancestor(int distance) {
@@ -51,12 +55,20 @@ namespace cpplox {
         return environment;
     }
 
-    Object *Environment::getAt(int distance, const std::string &name) {
-        return ancestor(distance)->values[name];
+    // 闭包经由外层环境链访问变量 整条链都要保留
+    void Environment::capture() {
+        for (Environment *environment = this; environment != nullptr && !environment->captured;
+             environment = environment->enclosing) {
+            environment->captured = true;
+        }
+    }
+
+    Object *Environment::getAt(int distance, int slot) {
+        return ancestor(distance)->slots[slot];
     }
 
-    void Environment::assignAt(int distance, Token &name, Object *value) {
-        ancestor(distance)->values[name.lexeme] = value;
+    void Environment::assignAt(int distance, int slot, Object *value) {
+        ancestor(distance)->slots[slot] = value;
     }
 
 
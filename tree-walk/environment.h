@@ -7,15 +7,19 @@
 
 #include <map>
 #include <string>
+#include <vector>
 #include "object.h"
 #include "token.h"
 
 namespace cpplox {
+    // 全局环境按名字保存变量 局部环境按声明顺序放在槽位中 下标就是解析器分配的槽位
     class Environment {
     private:
         std::map<std::string, Object *> values;
+        std::vector<Object *> slots;
     public:
         Environment *enclosing;
+        bool captured = false;  // 被闭包引用 块结束后不能释放
 
         explicit Environment(Environment *enclosing);
 
@@ -29,9 +33,11 @@ namespace cpplox {
 
         Environment* ancestor(int distance);
 
-        Object* getAt(int distance, const std::string& name);
+        void capture();
 
-        void assignAt(int distance, Token& name, Object* value);
+        Object *getAt(int distance, int slot);
+
+        void assignAt(int distance, int slot, Object *value);
 
         ~Environment();
     };
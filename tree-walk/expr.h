@@ -63,6 +63,10 @@ namespace cpplox {
         };
     }
 
+    // 变量 赋值 this super节点的depth为解析器算出的环境深度 slot为该环境中的槽位
+    // 解析器没找到局部变量时depth保持GLOBAL_DEPTH 按名字读写全局变量
+    const int GLOBAL_DEPTH = -1;
+
     class Expr {
     public:
         virtual Object *accept(expr::Visitor *visitor) = 0;
@@ -74,6 +78,8 @@ namespace cpplox {
     public:
         Token name;
         Expr *value;
+        int depth = GLOBAL_DEPTH;
+        int slot = 0;
 
         Assign(Token &name, Expr *value) {
             this->name = name;
@@ -237,6 +243,8 @@ namespace cpplox {
     public:
         Token keyword;
         Token method;
+        int depth = GLOBAL_DEPTH;
+        int slot = 0;
 
         Super(Token &keyword, Token &method) {
             this->keyword = keyword;
@@ -253,6 +261,8 @@ namespace cpplox {
     class This : public Expr {
     public:
         Token keyword;
+        int depth = GLOBAL_DEPTH;
+        int slot = 0;
 
         explicit This(Token& keyword) {
             this->keyword = keyword;
@@ -287,6 +297,8 @@ namespace cpplox {
     class Variable : public Expr {
     public:
         Token name;
+        int depth = GLOBAL_DEPTH;
+        int slot = 0;
 
         explicit Variable(Token &name) {
             this->name = name;
@@ -10,6 +10,7 @@ namespace cpplox {
     LoxFunction::LoxFunction(Function *declaration, Environment *closure, bool isInitializer) {
         this->declaration = declaration;
         this->closure = closure;
+        this->closure->capture();
         this->isInitializer = isInitializer;
     }
 
@@ -37,7 +38,8 @@ namespace cpplox {
         } catch (ReturnException &returnValue) {
             return returnValue.value;
         }
-        if (isInitializer) return closure->getAt(0, "this");
+        // this是bind创建的环境中唯一的变量
+        if (isInitializer) return closure->getAt(0, 0);
         return nullptr;
     }
 
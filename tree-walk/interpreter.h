@@ -34,7 +34,6 @@ namespace cpplox {
     private:
 
         Environment *environment;
-        std::map<Expr *, int> locals;
 
     public:
         Environment *globals;
@@ -43,8 +42,6 @@ namespace cpplox {
 
         void interpret(std::vector<Stmt *> &statements);
 
-        void resolve(Expr *expr, int depth);
-
         void executeBlock(const std::vector<Stmt *> &statements, Environment *environment);
 
         Object *visitBlockStmt(Block *stmt) override;
@@ -98,7 +95,7 @@ namespace cpplox {
 
         Object *evaluate(Expr *expr);
 
-        Object *lookUpVariable(Token &name, Expr *expr);
+        Object *lookUpVariable(Token &name, int depth, int slot);
     };
 
     class ReturnException : public std::exception {
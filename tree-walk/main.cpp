@@ -9,6 +9,7 @@
 #include "parser.h"
 #include "token.h"
 #include "resolver.h"
+#include "interpreter.h"
 
 namespace cpplox {
     bool hadError = false;
@@ -25,7 +26,7 @@ namespace cpplox {
 
         if (hadError) return;
 
-        Resolver resolver(interpreter);
+        Resolver resolver;
         resolver.resolve(statements);
 
         if (hadError) return;
@@ -37,10 +37,13 @@ namespace cpplox {
         currentFunction = enclosingFunction;
     }
 
-    void Resolver::resolveLocal(Expr *expr, Token &name) {
+    // 结果直接记在节点上 没找到时保持GLOBAL_DEPTH
+    void Resolver::resolveLocal(Token &name, int &depth, int &slot) {
         for (int i = (int) scopes.size() - 1; i >= 0; i--) {
-            if (scopes[i].find(name.lexeme) != scopes[i].end()) {
-                interpreter->resolve(expr, (int) scopes.size() - 1 - i);
+            auto local = scopes[i].find(name.lexeme);
+            if (local != scopes[i].end()) {
+                depth = (int) scopes.size() - 1 - i;
+                slot = local->second.slot;
                 return;
             }
         }
@@ -57,16 +60,24 @@ namespace cpplox {
     void Resolver::declare(Token &name) {
         if (scopes.empty()) return;
 
-        std::map<std::string, bool> &scope = scopes.back();
-        if (scope.find(name.lexeme) != scope.end()) {
+        std::map<std::string, Local> &scope = scopes.back();
+        auto local = scope.find(name.lexeme);
+        if (local != scope.end()) {
             error(name, "Already a variable with this name in this scope.");
+            local->second.defined = false;
+            return;
         }
-        scope[name.lexeme] = false;
+        scope.emplace(name.lexeme, Local{(int) scope.size(), false});
     }
 
     void Resolver::define(Token &name) {
         if (scopes.empty()) return;
-        scopes.back()[name.lexeme] = true;
+        scopes.back()[name.lexeme].defined = true;
+    }
+
+    // super和this由解释器隐式定义 各自独占一个作用域
+    void Resolver::declareImplicit(const std::string &name) {
+        scopes.back()[name] = Local{0, true};
     }
 
     Object *Resolver::visitBlockStmt(Block *stmt) {
@@ -94,11 +105,11 @@ namespace cpplox {
 
         if (stmt->superclass != nullptr) {
             beginScope();
-            scopes.back()["super"] = true;
+            declareImplicit("super");
         }
 
         beginScope();
-        scopes.back()["this"] = true;
+        declareImplicit("this");
 
         for (Function *method: stmt->methods) {
             FunctionType declaration = FunctionType::METHOD;
@@ -173,7 +184,7 @@ namespace cpplox {
 
     Object *Resolver::visitAssignExpr(Assign *expr) {
         resolve(expr->value);
-        resolveLocal(expr, expr->name);
+        resolveLocal(expr->name, expr->depth, expr->slot);
         return nullptr;
     }
 
@@ -224,7 +235,7 @@ namespace cpplox {
         } else if (currentClass != ClassType::SUBCLASS) {
             error(expr->keyword, "Can't use 'super' in a class with no superclass.");
         }
-        resolveLocal(expr, expr->keyword);
+        resolveLocal(expr->keyword, expr->depth, expr->slot);
         return nullptr;
     }
 
@@ -234,7 +245,7 @@ namespace cpplox {
             return nullptr;
         }
 
-        resolveLocal(expr, expr->keyword);
+        resolveLocal(expr->keyword, expr->depth, expr->slot);
         return nullptr;
     }
 
@@ -245,15 +256,11 @@ namespace cpplox {
 
     Object *Resolver::visitVariableExpr(Variable *expr) {
         if (!scopes.empty() && scopes.back().find(expr->name.lexeme) != scopes.back().end()
-            && !scopes.back()[expr->name.lexeme]) {
+            && !scopes.back()[expr->name.lexeme].defined) {
             error(expr->name, "Can't read local variable in its own initializer.");
         }
 
-        resolveLocal(expr, expr->name);
+        resolveLocal(expr->name, expr->depth, expr->slot);
         return nullptr;
     }
-
-    Resolver::Resolver(Interpreter *interpreter) {
-        this->interpreter = interpreter;
-    }
 }
\ No newline at end of file
@@ -9,7 +9,6 @@
 #include <map>
 #include "stmt.h"
 #include "expr.h"
-#include "interpreter.h"
 
 namespace cpplox {
 
@@ -26,15 +25,18 @@ namespace cpplox {
         SUBCLASS
     };
 
+    // 作用域中的局部变量 槽位按声明顺序分配 与运行时定义的顺序一致
+    struct Local {
+        int slot;
+        bool defined;
+    };
+
     class Resolver : public expr::Visitor, public stmt::Visitor {
     private:
-        Interpreter *interpreter;
-        std::deque<std::map<std::string, bool>> scopes;
+        std::deque<std::map<std::string, Local>> scopes;
         FunctionType currentFunction = FunctionType::NONE;
         ClassType currentClass = ClassType::NONE;
     public:
-        explicit Resolver(Interpreter *interpreter);
-
         void resolve(const std::vector<Stmt *> &statements);
 
     private:
@@ -44,7 +46,7 @@ namespace cpplox {
 
         void resolveFunction(Function *function, FunctionType type);
 
-        void resolveLocal(Expr *expr, Token &name);
+        void resolveLocal(Token &name, int &depth, int &slot);
 
         void beginScope();
 
@@ -54,6 +56,8 @@ namespace cpplox {
 
         void define(Token &name);
 
+        void declareImplicit(const std::string &name);
+
         Object *visitBlockStmt(Block *stmt) override;
 
         Object *visitClassStmt(Class *stmt) override;
@@ -0,0 +1,321 @@
+//
+// Created by hlx on 2023/10/4.
+//
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bytecode.h"
+#include "memory.h"
+#include "vm.h"
+
+namespace cpplox {
+
+    // 文件头魔数
+    static const char BYTECODE_MAGIC[4] = {'L', 'O', 'X', 'B'};
+
+    // 常量的类型标记
+    enum ConstantTag : uint8_t {
+        CONSTANT_NUMBER,
+        CONSTANT_STRING,
+        CONSTANT_FUNCTION,
+        CONSTANT_NIL,
+        CONSTANT_TRUE,
+        CONSTANT_FALSE
+    };
+
+    uint64_t hashSource(const char *source, size_t length) {
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < length; i++) {
+            hash ^= (uint8_t) source[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    std::string bytecodePath(const char *sourcePath) {
+        std::string path(sourcePath);
+        if (path.size() >= 4 && path.compare(path.size() - 4, 4, ".lox") == 0) return path + "c";
+        return path + ".loxc";
+    }
+
+    // 按本机字节序追加到缓冲区
+    class Writer {
+    public:
+        std::vector<uint8_t> bytes;
+
+        void write(const void *data, size_t size) {
+            auto *start = (const uint8_t *) data;
+            bytes.insert(bytes.end(), start, start + size);
+        }
+
+        template<typename T>
+        void write(T value) {
+            write(&value, sizeof(T));
+        }
+
+        void writeString(const char *chars, int length) {
+            write<uint32_t>(length);
+            write(chars, length);
+        }
+    };
+
+    static void writeFunction(Writer *writer, ObjFunction *function) {
+        writer->write<uint8_t>(function->name != nullptr);
+        if (function->name != nullptr) writer->writeString(function->name->chars, function->name->length);
+        writer->write<int32_t>(function->arity);
+        writer->write<int32_t>(function->upvalueCount);
+
+        // 字节码 行号 内联缓存数量 提升值描述符在OP_CLOSURE的操作数中
+        Chunk *chunk = function->chunk;
+        writer->write<uint32_t>(chunk->code.size());
+        writer->write(chunk->code.data(), chunk->code.size());
+        // 行号按游程编码 连续相同的行号记为(行号, 字节数)
+        std::vector<std::pair<int32_t, uint32_t>> runs;
+        for (int line: chunk->lines) {
+            if (!runs.empty() && runs.back().first == line) {
+                runs.back().second++;
+            } else {
+                runs.emplace_back(line, 1);
+            }
+        }
+        writer->write<uint32_t>(runs.size());
+        for (auto &run: runs) {
+            writer->write<int32_t>(run.first);
+            writer->write<uint32_t>(run.second);
+        }
+        writer->write<uint32_t>(chunk->caches.size());
+
+        writer->write<uint32_t>(chunk->constants.size());
+        for (size_t i = 0; i < chunk->constants.size(); i++) {
+            Value constant = chunk->constants[i];
+            if (IS_NUMBER(constant)) {
+                writer->write<uint8_t>(CONSTANT_NUMBER);
+                writer->write<double>(AS_NUMBER(constant));
+            } else if (IS_STRING(constant)) {
+                writer->write<uint8_t>(CONSTANT_STRING);
+                writer->writeString(AS_STRING(constant)->chars, AS_STRING(constant)->length);
+            } else if (IS_FUNCTION(constant)) {
+                writer->write<uint8_t>(CONSTANT_FUNCTION);
+                writeFunction(writer, AS_FUNCTION(constant));
+            } else if (IS_BOOL(constant)) {
+                writer->write<uint8_t>(AS_BOOL(constant) ? CONSTANT_TRUE : CONSTANT_FALSE);
+            } else {
+                writer->write<uint8_t>(CONSTANT_NIL);
+            }
+        }
+    }
+
+    bool writeBytecode(ObjFunction *function, uint64_t sourceHash, const char *path) {
+        Writer writer;
+        writer.write(BYTECODE_MAGIC, sizeof(BYTECODE_MAGIC));
+        writer.write<uint32_t>(BYTECODE_VERSION);
+        writer.write<uint32_t>(OPCODE_COUNT);
+        writer.write<uint64_t>(sourceHash);
+
+        // 编译时的全局变量槽位 加载时按名字映射到加载它的虚拟机的槽位
+        std::vector<ObjString *> names(vm->globalCount, nullptr);
+        for (int i = 0; i < vm->globalNames.capacity; i++) {
+            Entry *entry = &vm->globalNames.entries[i];
+            if (entry->key != nullptr) names[(int) AS_NUMBER(entry->value)] = entry->key;
+        }
+        writer.write<uint32_t>(names.size());
+        for (ObjString *name: names) writer.writeString(name->chars, name->length);
+
+        writeFunction(&writer, function);
+
+        // 先写到临时文件再改名 并发运行时读者不会看到写了一半的文件
+        std::string temporary = std::string(path) + ".XXXXXX";
+        int fd = mkstemp(&temporary[0]);
+        if (fd < 0) return false;
+        fchmod(fd, 0644);
+        size_t written = 0;
+        while (written < writer.bytes.size()) {
+            ssize_t count = ::write(fd, writer.bytes.data() + written, writer.bytes.size() - written);
+            if (count <= 0) break;
+            written += count;
+        }
+        close(fd);
+        if (written != writer.bytes.size() || rename(temporary.c_str(), path) != 0) {
+            unlink(temporary.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    // 从映射的文件中顺序读取 越界后ok为false 之后读到的都是0
+    class Reader {
+    public:
+        const uint8_t *cursor;
+        const uint8_t *end;
+        bool ok;
+
+        Reader(const uint8_t *start, size_t size) : cursor(start), end(start + size), ok(true) {}
+
+        const uint8_t *take(size_t size) {
+            if (!ok || (size_t) (end - cursor) < size) {
+                ok = false;
+                return nullptr;
+            }
+            const uint8_t *start = cursor;
+            cursor += size;
+            return start;
+        }
+
+        template<typename T>
+        T read() {
+            T value{};
+            const uint8_t *start = take(sizeof(T));
+            if (start != nullptr) memcpy(&value, start, sizeof(T));
+            return value;
+        }
+
+        // 读取字符串并驻留 失败返回nullptr
+        ObjString *readString() {
+            uint32_t length = read<uint32_t>();
+            const uint8_t *chars = take(length);
+            if (chars == nullptr) return nullptr;
+            return copyString((const char *) chars, (int) length);
+        }
+    };
+
+    // 把字节码中的全局变量槽位改为当前虚拟机的槽位 同时检查指令是否完整
+    static bool remapGlobals(Chunk *chunk, const std::vector<int> &slots) {
+        int offset = 0;
+        int count = (int) chunk->code.size();
+        while (offset < count) {
+            uint8_t instruction = chunk->code[offset];
+            if (instruction >= OPCODE_COUNT) return false;
+            if (instruction == OP_CLOSURE) {
+                if (offset + 1 >= count) return false;
+                uint8_t constant = chunk->code[offset + 1];
+                if (constant >= chunk->constants.size() || !IS_FUNCTION(chunk->constants[constant])) return false;
+            }
+            int length = chunk->instructionLength(offset);
+            if (offset + length > count) return false;
+
+            if (instruction == OP_GET_GLOBAL || instruction == OP_SET_GLOBAL || instruction == OP_DEFINE_GLOBAL) {
+                int slot = (chunk->code[offset + 1] << 8) | chunk->code[offset + 2];
+                if (slot >= (int) slots.size()) return false;
+                chunk->code[offset + 1] = (slots[slot] >> 8) & 0xff;
+                chunk->code[offset + 2] = slots[slot] & 0xff;
+            }
+            offset += length;
+        }
+        return true;
+    }
+
+    // 读取一个函数 读取期间函数放在虚拟机栈上 它的常量因此不会被回收
+    static ObjFunction *readFunction(Reader *reader, const std::vector<int> &slots) {
+        ObjFunction *function = newFunction();
+        vm->push(OBJ_VAL(function));
+
+        if (reader->read<uint8_t>()) function->name = reader->readString();
+        function->arity = reader->read<int32_t>();
+        function->upvalueCount = reader->read<int32_t>();
+
+        uint32_t codeCount = reader->read<uint32_t>();
+        const uint8_t *code = reader->take(codeCount);
+        std::vector<int> lines;
+        uint32_t runCount = reader->read<uint32_t>();
+        for (uint32_t i = 0; i < runCount && reader->ok; i++) {
+            int32_t line = reader->read<int32_t>();
+            uint32_t length = reader->read<uint32_t>();
+            if (length > codeCount - lines.size()) {
+                reader->ok = false;
+                break;
+            }
+            lines.insert(lines.end(), length, line);
+        }
+        uint32_t cacheCount = reader->read<uint32_t>();
+        if (reader->ok && lines.size() == codeCount && cacheCount <= UINT16_MAX + 1) {
+            function->chunk->assign(code, lines.data(), codeCount, (int) cacheCount);
+        } else {
+            reader->ok = false;
+        }
+
+        uint32_t constantCount = reader->ok ? reader->read<uint32_t>() : 0;
+        for (uint32_t i = 0; i < constantCount && reader->ok; i++) {
+            Value constant = NIL_VAL;
+            switch (reader->read<uint8_t>()) {
+                case CONSTANT_NUMBER:
+                    constant = NUMBER_VAL(reader->read<double>());
+                    break;
+                case CONSTANT_STRING: {
+                    ObjString *string = reader->readString();
+                    if (string != nullptr) constant = OBJ_VAL(string);
+                    break;
+                }
+                case CONSTANT_FUNCTION: {
+                    ObjFunction *nested = readFunction(reader, slots);
+                    if (nested != nullptr) constant = OBJ_VAL(nested);
+                    break;
+                }
+                case CONSTANT_NIL:
+                    break;
+                case CONSTANT_TRUE:
+                    constant = BOOL_VAL(true);
+                    break;
+                case CONSTANT_FALSE:
+                    constant = BOOL_VAL(false);
+                    break;
+                default:
+                    reader->ok = false;
+                    break;
+            }
+            function->chunk->addConstant(constant);
+        }
+
+        if (reader->ok && !remapGlobals(function->chunk, slots)) reader->ok = false;
+        vm->pop();
+        return reader->ok ? function : nullptr;
+    }
+
+    ObjFunction *readBytecode(const char *path, bool checkHash, uint64_t sourceHash) {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) return nullptr;
+        struct stat status{};
+        if (fstat(fd, &status) != 0 || status.st_size == 0) {
+            close(fd);
+            return nullptr;
+        }
+        size_t size = status.st_size;
+        void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED) return nullptr;
+
+        Reader reader((const uint8_t *) mapped, size);
+        const uint8_t *magic = reader.take(sizeof(BYTECODE_MAGIC));
+        bool valid = magic != nullptr && memcmp(magic, BYTECODE_MAGIC, sizeof(BYTECODE_MAGIC)) == 0 &&
+                     reader.read<uint32_t>() == BYTECODE_VERSION &&
+                     reader.read<uint32_t>() == OPCODE_COUNT;
+        uint64_t hash = reader.read<uint64_t>();
+        if (checkHash && hash != sourceHash) valid = false;
+
+        ObjFunction *function = nullptr;
+        if (valid && reader.ok) {
+            // 文件中的全局变量名依次分配到当前虚拟机的槽位
+            uint32_t globalCount = reader.read<uint32_t>();
+            std::vector<int> slots;
+            for (uint32_t i = 0; i < globalCount && reader.ok; i++) {
+                ObjString *name = reader.readString();
+                if (name == nullptr) break;
+                int slot = vm->globalSlot(name);
+                if (slot > UINT16_MAX) reader.ok = false;
+                slots.push_back(slot);
+            }
+            if (reader.ok) function = readFunction(&reader, slots);
+            if (reader.cursor != reader.end) function = nullptr;
+        }
+
+        munmap(mapped, size);
+        return function;
+    }
+
+}
@@ -0,0 +1,32 @@
+//
+// Created by hlx on 2023/10/4.
+//
+
+#ifndef CPPLOX_BYTECODE_H
+#define CPPLOX_BYTECODE_H
+
+#include <string>
+#include "common.h"
+#include "object.h"
+
+namespace cpplox {
+
+    // 字节码文件格式版本 文件结构变化时递增 操作码数量另行校验
+    const uint32_t BYTECODE_VERSION = 1;
+
+    // 源码的64位FNV-1a哈希 用来判断缓存是否过期
+    uint64_t hashSource(const char *source, size_t length);
+
+    // 源码文件对应的字节码缓存路径 x.lox对应x.loxc
+    std::string bytecodePath(const char *sourcePath);
+
+    // 把编译好的脚本函数连同全局变量名写成字节码文件 先写临时文件再改名
+    bool writeBytecode(ObjFunction *function, uint64_t sourceHash, const char *path);
+
+    // 用mmap读取字节码文件 checkHash为true时源码哈希必须与文件记录的一致
+    // 文件不存在 过期或损坏时返回nullptr 全局变量槽位按当前虚拟机重新映射
+    ObjFunction *readBytecode(const char *path, bool checkHash, uint64_t sourceHash);
+
+}
+
+#endif //CPPLOX_BYTECODE_H
@@ -1 +1,129 @@
-//// Created by hlx on 2023/10/4.//#include "chunk.h"#include "memory.h"#include "vm.h"namespace cpplox {    Chunk::~Chunk() {        lines.size();        size_t oldSize = sizeof(int) * lines.capacity() + sizeof(uint8_t) * code.capacity();        compute(oldSize, 0);    }    int Chunk::addConstant(Value value) {        vm.push(value);        this->constants.write(value);        vm.pop();        return (int) (this->constants.size() - 1);    }    void Chunk::write(uint8_t byte, int line) {        size_t oldSize = code.capacity();        code.push_back(byte);        lines.push_back(line);        size_t newSize = code.capacity();        if (oldSize != newSize) {            oldSize = oldSize * sizeof(uint8_t) + oldSize * sizeof(int);            newSize = newSize * sizeof(uint8_t) + newSize * sizeof(int);            compute(oldSize, newSize);        }    }}
\ No newline at end of file
+//
+// Created by hlx on 2023/10/4.
+//
+
+#include "chunk.h"
+#include "memory.h"
+#include "object.h"
+#include "vm.h"
+
+namespace cpplox {
+
+    Chunk::~Chunk() {
+        lines.size();
+        size_t oldSize = sizeof(int) * lines.capacity() + sizeof(uint8_t) * code.capacity()
+                         + sizeof(InlineCache) * caches.capacity();
+        compute(oldSize, 0);
+    }
+
+    int Chunk::addConstant(Value value) {
+        vm->push(value);
+        this->constants.write(value);
+        vm->pop();
+        return (int) (this->constants.size() - 1);
+    }
+
+    int Chunk::addCache() {
+        size_t oldSize = caches.capacity();
+        caches.push_back(InlineCache{});
+        size_t newSize = caches.capacity();
+        if (oldSize != newSize) {
+            compute(oldSize * sizeof(InlineCache), newSize * sizeof(InlineCache));
+        }
+        return (int) (caches.size() - 1);
+    }
+
+    void Chunk::assign(const uint8_t *bytes, const int *byteLines, size_t count, int cacheCount) {
+        size_t oldSize = sizeof(int) * lines.capacity() + sizeof(uint8_t) * code.capacity()
+                         + sizeof(InlineCache) * caches.capacity();
+        code.assign(bytes, bytes + count);
+        lines.assign(byteLines, byteLines + count);
+        caches.assign(cacheCount, InlineCache{});
+        size_t newSize = sizeof(int) * lines.capacity() + sizeof(uint8_t) * code.capacity()
+                         + sizeof(InlineCache) * caches.capacity();
+        compute(oldSize, newSize);
+    }
+
+    int Chunk::instructionLength(int offset) {
+        switch (code[offset]) {
+            case OP_NIL:
+            case OP_TRUE:
+            case OP_FALSE:
+            case OP_POP:
+            case OP_EQUAL:
+            case OP_GREATER:
+            case OP_LESS:
+            case OP_ADD:
+            case OP_SUBTRACT:
+            case OP_MULTIPLY:
+            case OP_DIVIDE:
+            case OP_ADD_NUMBER:
+            case OP_SUBTRACT_NUMBER:
+            case OP_MULTIPLY_NUMBER:
+            case OP_DIVIDE_NUMBER:
+            case OP_GREATER_NUMBER:
+            case OP_LESS_NUMBER:
+            case OP_NOT:
+            case OP_NEGATE:
+            case OP_PRINT:
+            case OP_CLOSE_UPVALUE:
+            case OP_RETURN:
+            case OP_INHERIT:
+                return 1;
+            case OP_CONSTANT:
+            case OP_GET_LOCAL:
+            case OP_SET_LOCAL:
+            case OP_GET_UPVALUE:
+            case OP_SET_UPVALUE:
+            case OP_CALL:
+            case OP_TAIL_CALL:
+            case OP_CLASS:
+            case OP_METHOD:
+                return 2;
+            case OP_GET_GLOBAL:
+            case OP_DEFINE_GLOBAL:
+            case OP_SET_GLOBAL:
+            case OP_JUMP:
+            case OP_JUMP_IF_FALSE:
+            case OP_LOOP:
+            case OP_POP_JUMP_IF_FALSE:
+            case OP_EQUAL_JUMP_IF_FALSE:
+            case OP_GREATER_JUMP_IF_FALSE:
+            case OP_LESS_JUMP_IF_FALSE:
+            case OP_ADD_LOCAL_CONSTANT:
+                return 3;
+            case OP_GET_PROPERTY:
+            case OP_SET_PROPERTY:
+            case OP_GET_SUPER:
+                return 4;
+            case OP_INVOKE:
+            case OP_SUPER_INVOKE:
+            case OP_GET_LOCAL_PROPERTY:
+                return 5;
+            case OP_CLOSURE: {
+                // 每个提升值两个字节 是否为局部变量 + 下标
+                ObjFunction *function = AS_FUNCTION(constants[code[offset + 1]]);
+                return 2 + function->upvalueCount * 2;
+            }
+            default:
+                return 1; // Unreachable.
+        }
+    }
+
+    void Chunk::write(uint8_t byte, int line) {
+        size_t oldSize = code.capacity();
+        code.push_back(byte);
+        lines.push_back(line);
+        size_t newSize = code.capacity();
+        if (oldSize != newSize) {
+            oldSize = oldSize * sizeof(uint8_t) + oldSize * sizeof(int);
+            newSize = newSize * sizeof(uint8_t) + newSize * sizeof(int);
+            compute(oldSize, newSize);
+        }
+    }
+
+    void Chunk::truncate(int offset) {
+        code.resize(offset);
+        lines.resize(offset);
+    }
+}
\ No newline at end of file
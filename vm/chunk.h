@@ -1 +1,123 @@
-//// Created by hlx on 2023/10/4.//#ifndef CPPLOX_CHUNK_H#define CPPLOX_CHUNK_H#include "common.h"#include "value.h"namespace cpplox {    //  字节操作码    enum OpCode {        OP_CONSTANT,        // 写入常量        OP_NIL,             // 空指令 nil        OP_TRUE,            // true指令        OP_FALSE,           // false指令        OP_POP,             // 弹出指令        OP_GET_LOCAL,       // 获取局部变量        OP_SET_LOCAL,       // 赋值局部变量        OP_GET_GLOBAL,      // 获取全局变量        OP_DEFINE_GLOBAL,   // 定义全局变量        OP_SET_GLOBAL,      // 赋值全局变量        OP_GET_UPVALUE,     // 获取升值指令        OP_SET_UPVALUE,     // 赋值升值指令        OP_GET_PROPERTY,    // 获取属性指令        OP_SET_PROPERTY,    // 赋值属性指令        OP_GET_SUPER,       // 获取父类指令        OP_EQUAL,           // 赋值指令 =        OP_GREATER,         // 大于指令 >        OP_LESS,            // 小于指令 <        OP_ADD,             // 加指令 +        OP_SUBTRACT,        // 减指令 -        OP_MULTIPLY,        // 乘指令 *        OP_DIVIDE,          // 除指令 /        OP_NOT,             // 非指令 !        OP_NEGATE,          // 负指令 -        OP_PRINT,           // 打印指令        OP_JUMP,            // 分支跳转指令        OP_JUMP_IF_FALSE,   // if false分支跳转指令        OP_LOOP,            // 循环指令        OP_CALL,            // 调用指令        OP_INVOKE,          // 执行指令        OP_SUPER_INVOKE,    // 父类执行指令        OP_CLOSURE,         // 闭包指令        OP_CLOSE_UPVALUE,   // 关闭提升值        OP_RETURN,          // 返回指令        OP_CLASS,           // 类指令        OP_INHERIT,         // 继承指令        OP_METHOD           // 方法指令    };    // 字节码块    class Chunk {    public:        std::vector<uint8_t> code;          // 字节码数组        std::vector<int> lines;             // 源码行号        ValueArray constants;               // 字节码块常量数组        Chunk() = default;        int addConstant(Value value);        void write(uint8_t byte, int line);        ~Chunk();    };}#endif //CPPLOX_CHUNK_H
\ No newline at end of file
+//
+// Created by hlx on 2023/10/4.
+//
+
+#ifndef CPPLOX_CHUNK_H
+#define CPPLOX_CHUNK_H
+
+#include "common.h"
+#include "value.h"
+
+namespace cpplox {
+    //  字节操作码
+    enum OpCode {
+        OP_CONSTANT,        // 写入常量
+        OP_NIL,             // 空指令 nil
+        OP_TRUE,            // true指令
+        OP_FALSE,           // false指令
+        OP_POP,             // 弹出指令
+        OP_GET_LOCAL,       // 获取局部变量
+        OP_SET_LOCAL,       // 赋值局部变量
+        OP_GET_GLOBAL,      // 获取全局变量
+        OP_DEFINE_GLOBAL,   // 定义全局变量
+        OP_SET_GLOBAL,      // 赋值全局变量
+        OP_GET_UPVALUE,     // 获取升值指令
+        OP_SET_UPVALUE,     // 赋值升值指令
+        OP_GET_PROPERTY,    // 获取属性指令
+        OP_SET_PROPERTY,    // 赋值属性指令
+        OP_GET_SUPER,       // 获取父类指令
+        OP_EQUAL,           // 赋值指令 =
+        OP_GREATER,         // 大于指令 >
+        OP_LESS,            // 小于指令 <
+        OP_ADD,             // 加指令 +
+        OP_SUBTRACT,        // 减指令 -
+        OP_MULTIPLY,        // 乘指令 *
+        OP_DIVIDE,          // 除指令 /
+        OP_NOT,             // 非指令 !
+        OP_NEGATE,          // 负指令 -
+        OP_PRINT,           // 打印指令
+        OP_JUMP,            // 分支跳转指令
+        OP_JUMP_IF_FALSE,   // if false分支跳转指令
+        OP_LOOP,            // 循环指令
+        OP_CALL,            // 调用指令
+        OP_TAIL_CALL,       // 尾调用指令 复用当前栈帧
+        OP_INVOKE,          // 执行指令
+        OP_SUPER_INVOKE,    // 父类执行指令
+        OP_CLOSURE,         // 闭包指令
+        OP_CLOSE_UPVALUE,   // 关闭提升值
+        OP_RETURN,          // 返回指令
+        OP_CLASS,           // 类指令
+        OP_INHERIT,         // 继承指令
+        OP_METHOD,          // 方法指令
+        // 以下为运行时改写出的数字特化指令 操作数不是数字时改回通用指令
+        OP_ADD_NUMBER,      // 数字加 +
+        OP_SUBTRACT_NUMBER, // 数字减 -
+        OP_MULTIPLY_NUMBER, // 数字乘 *
+        OP_DIVIDE_NUMBER,   // 数字除 /
+        OP_GREATER_NUMBER,  // 数字大于 >
+        OP_LESS_NUMBER,     // 数字小于 <
+        // 以下为窥孔优化合并出的超级指令
+        OP_POP_JUMP_IF_FALSE,       // 弹出条件 为false时跳转
+        OP_EQUAL_JUMP_IF_FALSE,     // 弹出两个值 不相等时跳转
+        OP_GREATER_JUMP_IF_FALSE,   // 弹出两个数字 不大于时跳转
+        OP_LESS_JUMP_IF_FALSE,      // 弹出两个数字 不小于时跳转
+        OP_GET_LOCAL_PROPERTY,      // 获取局部变量的属性
+        OP_ADD_LOCAL_CONSTANT       // 局部变量加上数字常量 不影响栈
+    };
+
+    // 操作码数量 新操作码追加在OP_ADD_LOCAL_CONSTANT之后时要一起修改
+    const int OPCODE_COUNT = OP_ADD_LOCAL_CONSTANT + 1;
+
+    class ObjClass;
+
+    class Shape;
+
+    // 多态内联缓存最多记录的条目数量
+    const int INLINE_CACHE_SIZE = 4;
+
+    // 内联缓存条目 实例属性以接收者的形状为键 父类方法以类为键
+    struct CacheEntry {
+        Shape *shape;       // 接收者的形状 父类方法时为nullptr
+        ObjClass *klass;    // 接收者的类
+        int version;        // 填充时类方法表的版本
+        int slot;           // 字段槽位 -1表示查到的是方法
+        Shape *transition;  // 写字段后的形状 与shape相同表示字段已存在
+        Value method;       // 查到的方法
+    };
+
+    // 调用点内联缓存 先单态 命中不同形状或类时升级为多态 满了之后为超态不再填充
+    struct InlineCache {
+        int count;                                  // 已缓存的条目数量
+        CacheEntry entries[INLINE_CACHE_SIZE];      // 缓存条目
+    };
+
+    // 字节码块
+    class Chunk {
+    public:
+        std::vector<uint8_t> code;          // 字节码数组
+        std::vector<int> lines;             // 源码行号
+        ValueArray constants;               // 字节码块常量数组
+        std::vector<InlineCache> caches;    // 调用点内联缓存 由指令操作数索引
+
+        Chunk() = default;
+
+        int addConstant(Value value);
+
+        int addCache();
+
+        void write(uint8_t byte, int line);
+
+        // 丢弃offset之后的字节码和行号 用于编译时改写刚生成的指令
+        void truncate(int offset);
+
+        // 整体写入字节码和行号 并预留cacheCount个内联缓存 用于加载字节码文件
+        void assign(const uint8_t *bytes, const int *byteLines, size_t count, int cacheCount);
+
+        // offset处的指令连同操作数占用的字节数
+        int instructionLength(int offset);
+
+        ~Chunk();
+    };
+}
+
+#endif //CPPLOX_CHUNK_H
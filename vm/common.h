@@ -1 +1,67 @@
-//// Created by hlx on 2023/10/4.//#ifndef CPPLOX_COMMON_H#define CPPLOX_COMMON_H#include <cstdbool>#include <cstddef>#include <cstdint>namespace cpplox {// NAN 装箱//#define NAN_BOXING// 无异常反汇编当前字节码块//#define DEBUG_PRINT_CODE// 打印虚拟机栈和反汇编说明//#define DEBUG_TRACE_EXECUTION// 频繁调用垃圾回收//#define DEBUG_STRESS_GC// 输出gc日志//#define DEBUG_LOG_GC// 局部变量最多值#define UINT8_COUNT (UINT8_MAX + 1)}#endif //CPPLOX_COMMON_H
\ No newline at end of file
+//
+// Created by hlx on 2023/10/4.
+//
+
+#ifndef CPPLOX_COMMON_H
+#define CPPLOX_COMMON_H
+
+#include <cstdbool>
+#include <cstddef>
+#include <cstdint>
+
+namespace cpplox {
+// NAN 装箱
+//#define NAN_BOXING
+
+// 无异常反汇编当前字节码块
+//#define DEBUG_PRINT_CODE
+// 打印虚拟机栈和反汇编说明
+//#define DEBUG_TRACE_EXECUTION
+
+// 频繁调用垃圾回收
+//#define DEBUG_STRESS_GC
+
+// 输出gc日志
+//#define DEBUG_LOG_GC
+
+// 退出时输出字符串驻留命中/未命中次数
+//#define DEBUG_STRING_STATS
+
+// 退出时输出各操作码的执行次数和相邻执行的操作码对的次数
+//#define DEBUG_OPCODE_STATS
+
+// 同时用rdtsc统计各操作码消耗的时钟周期 包含DEBUG_OPCODE_STATS
+//#define DEBUG_OPCODE_CYCLES
+
+#if defined(DEBUG_OPCODE_CYCLES) && !(defined(__x86_64__) || defined(__i386__))
+#undef DEBUG_OPCODE_CYCLES
+#endif
+
+#if defined(DEBUG_OPCODE_CYCLES) && !defined(DEBUG_OPCODE_STATS)
+#define DEBUG_OPCODE_STATS
+#endif
+
+// 线程化分派 用computed goto跳转表代替switch分派
+//#define COMPUTED_GOTO
+
+// computed goto是GCC/Clang扩展 其它编译器回退到switch
+#if defined(COMPUTED_GOTO) && !defined(__GNUC__)
+#undef COMPUTED_GOTO
+#endif
+
+// 基线JIT 热点函数编译成x86-64机器码 定义NO_JIT时关闭
+// 只支持x86-64 Linux上的非NaN装箱值 跟踪执行和操作码统计需要逐条解释 也关闭
+#ifndef NO_JIT
+#define JIT
+#endif
+
+#if defined(JIT) && (!defined(__x86_64__) || !defined(__linux__) || defined(NAN_BOXING) || \
+                     defined(DEBUG_TRACE_EXECUTION) || defined(DEBUG_OPCODE_STATS))
+#undef JIT
+#endif
+
+// 局部变量最多值
+#define UINT8_COUNT (UINT8_MAX + 1)
+}
+
+#endif //CPPLOX_COMMON_H
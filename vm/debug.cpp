@@ -1 +1,420 @@
-//// Created by hlx on 2023/10/4.//#include <cstdio>#include "debug.h"#include "value.h"#include "object.h"namespace cpplox{    void disassembleChunk(Chunk *chunk, const char *name) {        printf("== %s ==\n", name); // 打印字节码块名        // 遍历字节码块中的字节码        for (int offset = 0; offset < chunk->code.size();) {            offset = disassembleInstruction(chunk, offset);        }    }// 简单解释字节码名 + 偏移量    static int simpleInstruction(const char *name, int offset) {        printf("%s\n", name);        return offset + 1;    }// 字节指令 打印出slot的偏移量    static int byteInstruction(const char *name, Chunk *chunk, int offset) {        uint8_t slot = chunk->code[offset + 1];        printf("%-16s %4d\n", name, slot);        return offset + 2;    }// 跳转指令 操作数为两个字节    static int jumpInstruction(const char *name, int sign, Chunk *chunk, int offset) {        auto jump = (uint16_t) (chunk->code[offset + 1] << 8);        jump |= chunk->code[offset + 2];        printf("%-16s %4d -> %d\n", name, offset, offset + 3 + sign * jump);        return offset + 3;    }// 解释常量字节码 字节码名 + 常量值    static int constantInstruction(const char *name, Chunk *chunk, int offset) {        uint8_t constant = chunk->code[offset + 1];     // 拿出常量所在常量数组的索引        printf("%-16s %4d '", name, constant);  // 打印常量在常量数组的索引        chunk->constants[constant].print();  // 打印常量值        printf("'\n");        return offset + 2;  // 操作码 + 操作数 偏移量为2    }// 解释执行字节码块    static int invokeInstruction(const char *name, Chunk *chunk, int offset) {        uint8_t constant = chunk->code[offset + 1];        uint8_t argCount = chunk->code[offset + 2];        printf("%-16s (%d args) %4d '", name, argCount, constant);        chunk->constants[constant].print();        printf("'\n");        return offset + 3;    }    int disassembleInstruction(Chunk *chunk, int offset) {        printf("%04d ", offset);    // 字节码偏移量        // 行号打印        if (offset > 0 && chunk->lines[offset] == chunk->lines[offset - 1]) {            printf("   | ");        } else {            printf("%4d ", chunk->lines[offset]);        }        // 反汇编当前字节码        uint8_t instruction = chunk->code[offset];        switch (instruction) {            case OP_CONSTANT:                return constantInstruction("OP_CONSTANT", chunk, offset);            case OP_NIL:                return simpleInstruction("OP_NIL", offset);            case OP_TRUE:                return simpleInstruction("OP_TRUE", offset);            case OP_FALSE:                return simpleInstruction("OP_FALSE", offset);            case OP_POP:                return simpleInstruction("OP_POP", offset);            case OP_GET_LOCAL:                return byteInstruction("OP_GET_LOCAL", chunk, offset);            case OP_SET_LOCAL:                return byteInstruction("OP_SET_LOCAL", chunk, offset);            case OP_GET_GLOBAL:                return constantInstruction("OP_GET_GLOBAL", chunk, offset);            case OP_DEFINE_GLOBAL:                return constantInstruction("OP_DEFINE_GLOBAL", chunk, offset);            case OP_SET_GLOBAL:                return constantInstruction("OP_SET_GLOBAL", chunk, offset);            case OP_GET_UPVALUE:                return byteInstruction("OP_GET_UPVALUE", chunk, offset);            case OP_SET_UPVALUE:                return byteInstruction("OP_SET_UPVALUE", chunk, offset);            case OP_GET_PROPERTY:                return constantInstruction("OP_GET_PROPERTY", chunk, offset);            case OP_SET_PROPERTY:                return constantInstruction("OP_SET_PROPERTY", chunk, offset);            case OP_GET_SUPER:                return constantInstruction("OP_GET_SUPER", chunk, offset);            case OP_EQUAL:                return simpleInstruction("OP_EQUAL", offset);            case OP_GREATER:                return simpleInstruction("OP_GREATER", offset);            case OP_LESS:                return simpleInstruction("OP_LESS", offset);            case OP_ADD:                return simpleInstruction("OP_ADD", offset);            case OP_SUBTRACT:                return simpleInstruction("OP_SUBTRACT", offset);            case OP_MULTIPLY:                return simpleInstruction("OP_MULTIPLY", offset);            case OP_DIVIDE:                return simpleInstruction("OP_DIVIDE", offset);            case OP_NOT:                return simpleInstruction("OP_NOT", offset);            case OP_NEGATE:                return simpleInstruction("OP_NEGATE", offset);            case OP_PRINT:                return simpleInstruction("OP_PRINT", offset);            case OP_JUMP:                return jumpInstruction("OP_JUMP", 1, chunk, offset);            case OP_JUMP_IF_FALSE:                return jumpInstruction("OP_JUMP_IF_FALSE", 1, chunk, offset);            case OP_LOOP:                return jumpInstruction("OP_LOOP", -1, chunk, offset);            case OP_CALL:                return byteInstruction("OP_CALL", chunk, offset);            case OP_INVOKE:                return invokeInstruction("OP_INVOKE", chunk, offset);            case OP_SUPER_INVOKE:                return invokeInstruction("OP_SUPER_INVOKE", chunk, offset);            case OP_CLOSURE: {                offset++;                uint8_t constant = chunk->code[offset++];                printf("%-16s %4d ", "OP_CLOSURE", constant);                chunk->constants[constant].print();                printf("\n");                ObjFunction *function = AS_FUNCTION(chunk->constants[constant]);                for (int j = 0; j < function->upvalueCount; j++) {                    int isLocal = chunk->code[offset++];                    int index = chunk->code[offset++];                    printf("%04d      |                     %s %d\n",                           offset - 2, isLocal ? "local" : "upvalue", index);                }                return offset;            }            case OP_CLOSE_UPVALUE:                return simpleInstruction("OP_CLOSE_UPVALUE", offset);            case OP_RETURN:                return simpleInstruction("OP_RETURN", offset);            case OP_CLASS:                return constantInstruction("OP_CLASS", chunk, offset);            case OP_INHERIT:                return simpleInstruction("OP_INHERIT", offset);            case OP_METHOD:                return constantInstruction("OP_METHOD", chunk, offset);            default:                printf("Unknown opcode %d\n", instruction);                return offset + 1;        }    }}
\ No newline at end of file
+//
+// Created by hlx on 2023/10/4.
+//
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "debug.h"
+#include "value.h"
+#include "object.h"
+#include "register.h"
+#include "vm.h"
+
+namespace cpplox{
+
+    void disassembleChunk(Chunk *chunk, const char *name) {
+        printf("== %s ==\n", name); // 打印字节码块名
+
+        // 遍历字节码块中的字节码
+        for (int offset = 0; offset < chunk->code.size();) {
+            offset = disassembleInstruction(chunk, offset);
+        }
+    }
+
+// 简单解释字节码名 + 偏移量
+    static int simpleInstruction(const char *name, int offset) {
+        printf("%s\n", name);
+        return offset + 1;
+    }
+
+// 字节指令 打印出slot的偏移量
+    static int byteInstruction(const char *name, Chunk *chunk, int offset) {
+        uint8_t slot = chunk->code[offset + 1];
+        printf("%-16s %4d\n", name, slot);
+        return offset + 2;
+    }
+
+// 跳转指令 操作数为两个字节
+    static int jumpInstruction(const char *name, int sign, Chunk *chunk, int offset) {
+        auto jump = (uint16_t) (chunk->code[offset + 1] << 8);
+        jump |= chunk->code[offset + 2];
+        printf("%-16s %4d -> %d\n", name, offset, offset + 3 + sign * jump);
+        return offset + 3;
+    }
+
+// 解释常量字节码 字节码名 + 常量值
+    static int constantInstruction(const char *name, Chunk *chunk, int offset) {
+        uint8_t constant = chunk->code[offset + 1];     // 拿出常量所在常量数组的索引
+        printf("%-16s %4d '", name, constant);  // 打印常量在常量数组的索引
+        chunk->constants[constant].print();  // 打印常量值
+        printf("'\n");
+        return offset + 2;  // 操作码 + 操作数 偏移量为2
+    }
+
+// 全局变量指令 两字节槽位下标 + 变量名
+    static int globalInstruction(const char *name, Chunk *chunk, int offset) {
+        int slot = (chunk->code[offset + 1] << 8) | chunk->code[offset + 2];
+        ObjString *global = vm->globalName(slot);
+        printf("%-16s %4d '%s'\n", name, slot, global != nullptr ? global->chars : "");
+        return offset + 3;
+    }
+
+// 解释执行字节码块
+    static int invokeInstruction(const char *name, Chunk *chunk, int offset) {
+        uint8_t constant = chunk->code[offset + 1];
+        uint8_t argCount = chunk->code[offset + 2];
+        int cache = (chunk->code[offset + 3] << 8) | chunk->code[offset + 4];
+        printf("%-16s (%d args) %4d '", name, argCount, constant);
+        chunk->constants[constant].print();
+        printf("' ic %d\n", cache);
+        return offset + 5;
+    }
+
+// 带内联缓存的常量指令 常量索引 + 两字节缓存索引
+    static int cachedInstruction(const char *name, Chunk *chunk, int offset) {
+        uint8_t constant = chunk->code[offset + 1];
+        int cache = (chunk->code[offset + 2] << 8) | chunk->code[offset + 3];
+        printf("%-16s %4d '", name, constant);
+        chunk->constants[constant].print();
+        printf("' ic %d\n", cache);
+        return offset + 4;
+    }
+
+// 局部变量的属性 槽位 + 属性名常量 + 两字节缓存索引
+    static int localPropertyInstruction(const char *name, Chunk *chunk, int offset) {
+        uint8_t slot = chunk->code[offset + 1];
+        uint8_t constant = chunk->code[offset + 2];
+        int cache = (chunk->code[offset + 3] << 8) | chunk->code[offset + 4];
+        printf("%-16s %4d %4d '", name, slot, constant);
+        chunk->constants[constant].print();
+        printf("' ic %d\n", cache);
+        return offset + 5;
+    }
+
+// 局部变量加常量 槽位 + 常量
+    static int localConstantInstruction(const char *name, Chunk *chunk, int offset) {
+        uint8_t slot = chunk->code[offset + 1];
+        uint8_t constant = chunk->code[offset + 2];
+        printf("%-16s %4d %4d '", name, slot, constant);
+        chunk->constants[constant].print();
+        printf("'\n");
+        return offset + 3;
+    }
+
+    int disassembleInstruction(Chunk *chunk, int offset) {
+        printf("%04d ", offset);    // 字节码偏移量
+        // 行号打印
+        if (offset > 0 && chunk->lines[offset] == chunk->lines[offset - 1]) {
+            printf("   | ");
+        } else {
+            printf("%4d ", chunk->lines[offset]);
+        }
+
+        // 反汇编当前字节码
+        uint8_t instruction = chunk->code[offset];
+        switch (instruction) {
+            case OP_CONSTANT:
+                return constantInstruction("OP_CONSTANT", chunk, offset);
+            case OP_NIL:
+                return simpleInstruction("OP_NIL", offset);
+            case OP_TRUE:
+                return simpleInstruction("OP_TRUE", offset);
+            case OP_FALSE:
+                return simpleInstruction("OP_FALSE", offset);
+            case OP_POP:
+                return simpleInstruction("OP_POP", offset);
+            case OP_GET_LOCAL:
+                return byteInstruction("OP_GET_LOCAL", chunk, offset);
+            case OP_SET_LOCAL:
+                return byteInstruction("OP_SET_LOCAL", chunk, offset);
+            case OP_GET_GLOBAL:
+                return globalInstruction("OP_GET_GLOBAL", chunk, offset);
+            case OP_DEFINE_GLOBAL:
+                return globalInstruction("OP_DEFINE_GLOBAL", chunk, offset);
+            case OP_SET_GLOBAL:
+                return globalInstruction("OP_SET_GLOBAL", chunk, offset);
+            case OP_GET_UPVALUE:
+                return byteInstruction("OP_GET_UPVALUE", chunk, offset);
+            case OP_SET_UPVALUE:
+                return byteInstruction("OP_SET_UPVALUE", chunk, offset);
+            case OP_GET_PROPERTY:
+                return cachedInstruction("OP_GET_PROPERTY", chunk, offset);
+            case OP_SET_PROPERTY:
+                return cachedInstruction("OP_SET_PROPERTY", chunk, offset);
+            case OP_GET_SUPER:
+                return cachedInstruction("OP_GET_SUPER", chunk, offset);
+            case OP_EQUAL:
+                return simpleInstruction("OP_EQUAL", offset);
+            case OP_GREATER:
+                return simpleInstruction("OP_GREATER", offset);
+            case OP_LESS:
+                return simpleInstruction("OP_LESS", offset);
+            case OP_ADD:
+                return simpleInstruction("OP_ADD", offset);
+            case OP_SUBTRACT:
+                return simpleInstruction("OP_SUBTRACT", offset);
+            case OP_MULTIPLY:
+                return simpleInstruction("OP_MULTIPLY", offset);
+            case OP_DIVIDE:
+                return simpleInstruction("OP_DIVIDE", offset);
+            case OP_ADD_NUMBER:
+                return simpleInstruction("OP_ADD_NUMBER", offset);
+            case OP_SUBTRACT_NUMBER:
+                return simpleInstruction("OP_SUBTRACT_NUMBER", offset);
+            case OP_MULTIPLY_NUMBER:
+                return simpleInstruction("OP_MULTIPLY_NUMBER", offset);
+            case OP_DIVIDE_NUMBER:
+                return simpleInstruction("OP_DIVIDE_NUMBER", offset);
+            case OP_GREATER_NUMBER:
+                return simpleInstruction("OP_GREATER_NUMBER", offset);
+            case OP_LESS_NUMBER:
+                return simpleInstruction("OP_LESS_NUMBER", offset);
+            case OP_NOT:
+                return simpleInstruction("OP_NOT", offset);
+            case OP_NEGATE:
+                return simpleInstruction("OP_NEGATE", offset);
+            case OP_PRINT:
+                return simpleInstruction("OP_PRINT", offset);
+            case OP_JUMP:
+                return jumpInstruction("OP_JUMP", 1, chunk, offset);
+            case OP_JUMP_IF_FALSE:
+                return jumpInstruction("OP_JUMP_IF_FALSE", 1, chunk, offset);
+            case OP_LOOP:
+                return jumpInstruction("OP_LOOP", -1, chunk, offset);
+            case OP_POP_JUMP_IF_FALSE:
+                return jumpInstruction("OP_POP_JUMP_IF_FALSE", 1, chunk, offset);
+            case OP_EQUAL_JUMP_IF_FALSE:
+                return jumpInstruction("OP_EQUAL_JUMP_IF_FALSE", 1, chunk, offset);
+            case OP_GREATER_JUMP_IF_FALSE:
+                return jumpInstruction("OP_GREATER_JUMP_IF_FALSE", 1, chunk, offset);
+            case OP_LESS_JUMP_IF_FALSE:
+                return jumpInstruction("OP_LESS_JUMP_IF_FALSE", 1, chunk, offset);
+            case OP_GET_LOCAL_PROPERTY:
+                return localPropertyInstruction("OP_GET_LOCAL_PROPERTY", chunk, offset);
+            case OP_ADD_LOCAL_CONSTANT:
+                return localConstantInstruction("OP_ADD_LOCAL_CONSTANT", chunk, offset);
+            case OP_CALL:
+                return byteInstruction("OP_CALL", chunk, offset);
+            case OP_TAIL_CALL:
+                return byteInstruction("OP_TAIL_CALL", chunk, offset);
+            case OP_INVOKE:
+                return invokeInstruction("OP_INVOKE", chunk, offset);
+            case OP_SUPER_INVOKE:
+                return invokeInstruction("OP_SUPER_INVOKE", chunk, offset);
+            case OP_CLOSURE: {
+                offset++;
+                uint8_t constant = chunk->code[offset++];
+                printf("%-16s %4d ", "OP_CLOSURE", constant);
+                chunk->constants[constant].print();
+                printf("\n");
+
+                ObjFunction *function = AS_FUNCTION(chunk->constants[constant]);
+                for (int j = 0; j < function->upvalueCount; j++) {
+                    int isLocal = chunk->code[offset++];
+                    int index = chunk->code[offset++];
+                    printf("%04d      |                     %s %d\n",
+                           offset - 2, isLocal ? "local" : "upvalue", index);
+                }
+
+                return offset;
+            }
+            case OP_CLOSE_UPVALUE:
+                return simpleInstruction("OP_CLOSE_UPVALUE", offset);
+            case OP_RETURN:
+                return simpleInstruction("OP_RETURN", offset);
+            case OP_CLASS:
+                return constantInstruction("OP_CLASS", chunk, offset);
+            case OP_INHERIT:
+                return simpleInstruction("OP_INHERIT", offset);
+            case OP_METHOD:
+                return constantInstruction("OP_METHOD", chunk, offset);
+            default:
+                printf("Unknown opcode %d\n", instruction);
+                return offset + 1;
+        }
+    }
+
+    // 下标为操作码 顺序必须与OpCode一致
+    static const char *OPCODE_NAMES[] = {
+            "OP_CONSTANT", "OP_NIL", "OP_TRUE", "OP_FALSE", "OP_POP", "OP_GET_LOCAL", "OP_SET_LOCAL",
+            "OP_GET_GLOBAL", "OP_DEFINE_GLOBAL", "OP_SET_GLOBAL", "OP_GET_UPVALUE", "OP_SET_UPVALUE",
+            "OP_GET_PROPERTY", "OP_SET_PROPERTY", "OP_GET_SUPER", "OP_EQUAL", "OP_GREATER", "OP_LESS",
+            "OP_ADD", "OP_SUBTRACT", "OP_MULTIPLY", "OP_DIVIDE", "OP_NOT", "OP_NEGATE", "OP_PRINT", "OP_JUMP",
+            "OP_JUMP_IF_FALSE", "OP_LOOP", "OP_CALL", "OP_TAIL_CALL", "OP_INVOKE", "OP_SUPER_INVOKE",
+            "OP_CLOSURE", "OP_CLOSE_UPVALUE", "OP_RETURN", "OP_CLASS", "OP_INHERIT", "OP_METHOD",
+            "OP_ADD_NUMBER", "OP_SUBTRACT_NUMBER", "OP_MULTIPLY_NUMBER", "OP_DIVIDE_NUMBER", "OP_GREATER_NUMBER",
+            "OP_LESS_NUMBER", "OP_POP_JUMP_IF_FALSE", "OP_EQUAL_JUMP_IF_FALSE", "OP_GREATER_JUMP_IF_FALSE",
+            "OP_LESS_JUMP_IF_FALSE", "OP_GET_LOCAL_PROPERTY", "OP_ADD_LOCAL_CONSTANT",
+    };
+
+    static_assert(sizeof(OPCODE_NAMES) / sizeof(OPCODE_NAMES[0]) == OPCODE_COUNT, "missing opcode name");
+
+    const char *opcodeName(uint8_t opcode) {
+        return opcode < OPCODE_COUNT ? OPCODE_NAMES[opcode] : "OP_UNKNOWN";
+    }
+
+    // 寄存器操作码的名字 下标为操作码
+    static const char *const REGISTER_OP_NAMES[] = {
+            "R_MOVE",
+            "R_GET_GLOBAL",
+            "R_DEFINE_GLOBAL",
+            "R_SET_GLOBAL",
+            "R_ADD",
+            "R_SUBTRACT",
+            "R_MULTIPLY",
+            "R_DIVIDE",
+            "R_EQUAL",
+            "R_GREATER",
+            "R_LESS",
+            "R_NOT",
+            "R_NEGATE",
+            "R_JUMP",
+            "R_JUMP_IF_FALSE",
+            "R_EQUAL_JUMP",
+            "R_GREATER_JUMP",
+            "R_LESS_JUMP",
+            "R_LOOP",
+            "R_CALL",
+            "R_RETURN",
+            "R_EXIT",
+    };
+
+    static_assert(sizeof(REGISTER_OP_NAMES) / sizeof(REGISTER_OP_NAMES[0]) == REGISTER_OP_COUNT,
+                  "missing register op name");
+
+// 寄存器操作数 槽位打印为r 常量打印为常量值
+    static void printOperand(RegisterCode *registers, int32_t operand) {
+        if (operand >= 0) {
+            printf(" r%d", operand);
+        } else {
+            printf(" '");
+            registers->constants[-1 - operand].print();
+            printf("'");
+        }
+    }
+
+    void disassembleRegisters(RegisterCode *registers, const char *name) {
+        printf("== %s registers ==\n", name);
+        for (size_t i = 0; i < registers->code.size(); i++) {
+            RegisterInstruction &instruction = registers->code[i];
+            printf("%04zu %04u %-16s", i, instruction.origin, REGISTER_OP_NAMES[instruction.op]);
+            switch (instruction.op) {
+                case R_MOVE:
+                case R_NOT:
+                case R_NEGATE:
+                    printf(" r%d =", instruction.a);
+                    printOperand(registers, instruction.b);
+                    break;
+                case R_GET_GLOBAL:
+                    printf(" r%d = g%d", instruction.a, instruction.b);
+                    break;
+                case R_DEFINE_GLOBAL:
+                case R_SET_GLOBAL:
+                    printf(" g%d =", instruction.a);
+                    printOperand(registers, instruction.b);
+                    break;
+                case R_JUMP:
+                case R_LOOP:
+                    printf(" -> %d", instruction.a);
+                    break;
+                case R_JUMP_IF_FALSE:
+                    printOperand(registers, instruction.b);
+                    printf(" -> %d", instruction.a);
+                    break;
+                case R_EQUAL_JUMP:
+                case R_GREATER_JUMP:
+                case R_LESS_JUMP:
+                    printOperand(registers, instruction.b);
+                    printOperand(registers, instruction.c);
+                    printf(" -> %d", instruction.a);
+                    break;
+                case R_CALL:
+                    printf(" r%d (%d args)", instruction.a, instruction.b);
+                    break;
+                case R_RETURN:
+                    printOperand(registers, instruction.b);
+                    break;
+                case R_EXIT:
+                    printf(" @%d depth %d", instruction.a, instruction.depth);
+                    break;
+                default:
+                    printf(" r%d =", instruction.a);
+                    printOperand(registers, instruction.b);
+                    printOperand(registers, instruction.c);
+                    break;
+            }
+            printf("\n");
+        }
+    }
+
+#ifdef DEBUG_OPCODE_STATS
+    // 输出的操作码对数量
+    static const int STATS_TOP_PAIRS = 32;
+
+    void printOpcodeStats(FILE *file, OpcodeStats *stats) {
+        uint64_t total = 0;
+        std::vector<int> order;
+        for (int i = 0; i < OPCODE_COUNT; i++) {
+            total += stats->counts[i];
+            if (stats->counts[i] > 0) order.push_back(i);
+        }
+        if (total == 0 && stats->registerInstructions == 0) return;
+        std::sort(order.begin(), order.end(), [stats](int a, int b) {
+            return stats->counts[a] > stats->counts[b];
+        });
+
+        // 名字列按最长的操作码名对齐
+        int width = 0;
+        for (int i = 0; i < OPCODE_COUNT; i++) {
+            width = std::max(width, (int) strlen(opcodeName(i)));
+        }
+
+        // 周期数包含rdtsc本身的开销 适合比较操作码之间的相对开销
+#ifdef DEBUG_OPCODE_CYCLES
+        fprintf(file, "%-*s %14s %8s %16s %10s\n", width, "opcode", "count", "%", "cycles", "cycles/op");
+#else
+        fprintf(file, "%-*s %14s %8s\n", width, "opcode", "count", "%");
+#endif
+        for (int opcode: order) {
+            uint64_t count = stats->counts[opcode];
+            fprintf(file, "%-*s %14llu %7.2f%%", width, opcodeName(opcode), (unsigned long long) count,
+                    100.0 * count / total);
+#ifdef DEBUG_OPCODE_CYCLES
+            fprintf(file, " %16llu %10.1f", (unsigned long long) stats->cycles[opcode],
+                    (double) stats->cycles[opcode] / count);
+#endif
+            fprintf(file, "\n");
+        }
+
+        std::vector<std::pair<int, int>> pairs;
+        for (int i = 0; i < OPCODE_COUNT; i++) {
+            for (int j = 0; j < OPCODE_COUNT; j++) {
+                if (stats->pairs[i][j] > 0) pairs.emplace_back(i, j);
+            }
+        }
+        std::sort(pairs.begin(), pairs.end(), [stats](const std::pair<int, int> &a, const std::pair<int, int> &b) {
+            return stats->pairs[a.first][a.second] > stats->pairs[b.first][b.second];
+        });
+        if (pairs.size() > STATS_TOP_PAIRS) pairs.resize(STATS_TOP_PAIRS);
+
+        int pairWidth = width * 2 + 4;
+        fprintf(file, "\n%-*s %14s %8s\n", pairWidth, "pair", "count", "%");
+        for (auto &pair: pairs) {
+            uint64_t count = stats->pairs[pair.first][pair.second];
+            std::string name = std::string(opcodeName(pair.first)) + " -> " + opcodeName(pair.second);
+            fprintf(file, "%-*s %14llu %7.2f%%\n", pairWidth, name.c_str(), (unsigned long long) count,
+                    100.0 * count / total);
+        }
+
+        fprintf(file, "\nspecializations %llu, despecializations %llu\n",
+                (unsigned long long) stats->specializations, (unsigned long long) stats->despecializations);
+        if (stats->registerInstructions > 0) {
+            fprintf(file, "stack instructions %llu, register instructions %llu\n",
+                    (unsigned long long) total, (unsigned long long) stats->registerInstructions);
+        }
+    }
+#endif
+}
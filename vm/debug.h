@@ -5,6 +5,7 @@
 #ifndef CPPLOX_DEBUG_H
 #define CPPLOX_DEBUG_H
 
+#include <cstdio>
 #include "chunk.h"
 
 namespace cpplox{
@@ -15,6 +16,21 @@ namespace cpplox{
     // 反汇编说明
     int disassembleInstruction(Chunk* chunk, int offset);
 
+    // 操作码的名字
+    const char *opcodeName(uint8_t opcode);
+
+    struct RegisterCode;
+
+    // 反汇编寄存器代码 每条指令附带翻译自的字节码偏移
+    void disassembleRegisters(RegisterCode *registers, const char *name);
+
+#ifdef DEBUG_OPCODE_STATS
+    struct OpcodeStats;
+
+    // 按执行次数输出操作码统计和最常见的相邻操作码对
+    void printOpcodeStats(FILE *file, OpcodeStats *stats);
+#endif
+
 }
 
 #endif //CPPLOX_DEBUG_H
@@ -0,0 +1,788 @@
+//
+// Created by hlx on 2023/10/4.
+//
+
+#include "jit.h"
+
+#ifdef JIT
+
+#include <cstring>
+#include <initializer_list>
+#include <vector>
+
+#include <sys/mman.h>
+
+#include "memory.h"
+#include "profiler.h"
+#include "vm.h"
+
+namespace cpplox {
+
+    // 机器码按这个布局读写值 类型在前 负载在后
+    static_assert(sizeof(Value) == 16, "jit expects 16-byte values");
+    static_assert(offsetof(Value, as) == 8, "jit expects the payload at offset 8");
+    static_assert(sizeof(ValueType) == 4, "jit expects 4-byte value types");
+    static_assert(sizeof(sig_atomic_t) == 4, "jit expects a 4-byte profile flag");
+
+    // 用到的通用寄存器编号
+    // r12 虚拟机栈顶 r13 虚拟机 r14 当前帧的局部变量 r15 当前帧 都是被调用者保存的
+    enum Register {
+        RAX = 0,
+        RCX = 1,
+        RDX = 2,
+        RSP = 4,
+        RSI = 6,
+        RDI = 7,
+        R12 = 12,
+        R13 = 13,
+        R14 = 14,
+        R15 = 15
+    };
+
+    enum XmmRegister {
+        XMM0 = 0,
+        XMM1 = 1
+    };
+
+    // 条件码 加到jcc和setcc的操作码上
+    enum Condition : uint8_t {
+        CC_E = 0x4,
+        CC_NE = 0x5,
+        CC_AE = 0x3,
+        CC_BE = 0x6,
+        CC_A = 0x7,
+        CC_NP = 0xB
+    };
+
+    // 机器码入口 target为要执行的第一条指令的机器码
+    typedef void (*JitEntry)(VM *vm, CallFrame *frame, const uint8_t *target);
+
+    // 运行时回调 ip指向正在执行的指令 返回false时退出到解释器重新执行这条指令
+    typedef bool (*JitHelper)(VM *vm, CallFrame *frame, const uint8_t *ip);
+
+    // 只支持这里用到的x86-64指令 内存操作数统一为[base + disp32]
+    class Assembler {
+    public:
+        std::vector<uint8_t> code;
+
+        size_t size() {
+            return code.size();
+        }
+
+        void byte(uint8_t value) {
+            code.push_back(value);
+        }
+
+        void int32(int32_t value) {
+            uint8_t bytes[4];
+            memcpy(bytes, &value, 4);
+            code.insert(code.end(), bytes, bytes + 4);
+        }
+
+        void int64(uint64_t value) {
+            uint8_t bytes[8];
+            memcpy(bytes, &value, 8);
+            code.insert(code.end(), bytes, bytes + 8);
+        }
+
+        // 带内存操作数的指令 prefix为SSE的强制前缀 必须在REX之前
+        void memory(uint8_t prefix, bool wide, std::initializer_list<uint8_t> opcode, int reg, int base,
+                    int32_t disp) {
+            if (prefix != 0) byte(prefix);
+            rex(wide, reg, base);
+            for (uint8_t value: opcode) byte(value);
+            byte(0x80 | ((reg & 7) << 3) | (base & 7));
+            // rsp和r12作基址时需要SIB字节
+            if ((base & 7) == 4) byte(0x24);
+            int32(disp);
+        }
+
+        // 两个操作数都是寄存器的指令
+        void direct(uint8_t prefix, bool wide, std::initializer_list<uint8_t> opcode, int reg, int rm) {
+            if (prefix != 0) byte(prefix);
+            rex(wide, reg, rm);
+            for (uint8_t value: opcode) byte(value);
+            byte(0xC0 | ((reg & 7) << 3) | (rm & 7));
+        }
+
+        void load(int dst, int base, int32_t disp) {
+            memory(0, true, {0x8B}, dst, base, disp);
+        }
+
+        void store(int base, int32_t disp, int src) {
+            memory(0, true, {0x89}, src, base, disp);
+        }
+
+        void storeByte(int base, int32_t disp, int src) {
+            memory(0, false, {0x88}, src, base, disp);
+        }
+
+        // 写32位立即数 wide时符号扩展为64位
+        void storeImmediate(int base, int32_t disp, int32_t value, bool wide) {
+            memory(0, wide, {0xC7}, 0, base, disp);
+            int32(value);
+        }
+
+        void compareInt32(int base, int32_t disp, int8_t value) {
+            memory(0, false, {0x83}, 7, base, disp);
+            byte(value);
+        }
+
+        void compareByte(int base, int32_t disp, int8_t value) {
+            memory(0, false, {0x80}, 7, base, disp);
+            byte(value);
+        }
+
+        void compare(int reg, int base, int32_t disp) {
+            memory(0, true, {0x3B}, reg, base, disp);
+        }
+
+        void move(int dst, int src) {
+            direct(0, true, {0x89}, src, dst);
+        }
+
+        void moveImmediate(int dst, uint64_t value) {
+            rex(true, 0, dst);
+            byte(0xB8 + (dst & 7));
+            int64(value);
+        }
+
+        void addImmediate(int reg, int8_t value) {
+            direct(0, true, {0x83}, 0, reg);
+            byte(value);
+        }
+
+        void subImmediate(int reg, int8_t value) {
+            direct(0, true, {0x83}, 5, reg);
+            byte(value);
+        }
+
+        // 16字节的值整体搬运
+        void loadValue(int xmm, int base, int32_t disp) {
+            memory(0xF3, false, {0x0F, 0x6F}, xmm, base, disp);
+        }
+
+        void storeValue(int base, int32_t disp, int xmm) {
+            memory(0xF3, false, {0x0F, 0x7F}, xmm, base, disp);
+        }
+
+        void loadDouble(int xmm, int base, int32_t disp) {
+            memory(0xF2, false, {0x0F, 0x10}, xmm, base, disp);
+        }
+
+        void storeDouble(int base, int32_t disp, int xmm) {
+            memory(0xF2, false, {0x0F, 0x11}, xmm, base, disp);
+        }
+
+        // addsd subsd mulsd divsd 的操作码分别为0x58 0x5C 0x59 0x5E
+        void arithmetic(uint8_t opcode, int xmm, int base, int32_t disp) {
+            memory(0xF2, false, {0x0F, opcode}, xmm, base, disp);
+        }
+
+        void compareDouble(int left, int right) {
+            direct(0x66, false, {0x0F, 0x2E}, left, right);
+        }
+
+        void set(Condition condition, int reg) {
+            direct(0, false, {0x0F, (uint8_t) (0x90 + condition)}, 0, reg);
+        }
+
+        // 翻转符号位
+        void flipSign(int reg) {
+            direct(0, true, {0x0F, 0xBA}, 7, reg);
+            byte(63);
+        }
+
+        void andByte(int dst, int src) {
+            direct(0, false, {0x20}, src, dst);
+        }
+
+        void testByte(int reg) {
+            direct(0, false, {0x84}, reg, reg);
+        }
+
+        void callIndirect(int reg) {
+            direct(0, false, {0xFF}, 2, reg);
+        }
+
+        void jumpIndirect(int reg) {
+            direct(0, false, {0xFF}, 4, reg);
+        }
+
+        void push(int reg) {
+            rex(false, 0, reg);
+            byte(0x50 + (reg & 7));
+        }
+
+        void pop(int reg) {
+            rex(false, 0, reg);
+            byte(0x58 + (reg & 7));
+        }
+
+        void ret() {
+            byte(0xC3);
+        }
+
+        // 32位相对跳转 返回待回填的位置
+        size_t jump() {
+            byte(0xE9);
+            int32(0);
+            return code.size() - 4;
+        }
+
+        size_t jump(Condition condition) {
+            byte(0x0F);
+            byte(0x80 + condition);
+            int32(0);
+            return code.size() - 4;
+        }
+
+        // 把at处的跳转指向target
+        void patch(size_t at, size_t target) {
+            int32_t offset = (int32_t) (target - (at + 4));
+            memcpy(&code[at], &offset, 4);
+        }
+
+    private:
+        void rex(bool wide, int reg, int rm) {
+            uint8_t value = 0x40 | (wide ? 8 : 0) | ((reg & 8) ? 4 : 0) | ((rm & 8) ? 1 : 0);
+            if (value != 0x40) byte(value);
+        }
+    };
+
+    // 机器码回调的运行时函数 与解释器的对应指令一致 会出错时不修改状态直接返回false
+    class JitRuntime {
+    public:
+        static bool add(VM *vm, CallFrame *, const uint8_t *) {
+            if (!IS_ANY_STRING(vm->peek(0)) || !IS_ANY_STRING(vm->peek(1))) return false;
+            vm->concatenate();
+            return true;
+        }
+
+        static bool equal(VM *vm, CallFrame *, const uint8_t *) {
+            Value b = vm->pop();
+            Value a = vm->pop();
+            vm->push(BOOL_VAL(a == b));
+            return true;
+        }
+
+        static bool negateTruth(VM *vm, CallFrame *, const uint8_t *) {
+            Value value = vm->pop();
+            vm->push(BOOL_VAL(IS_NIL(value) || (IS_BOOL(value) && !AS_BOOL(value))));
+            return true;
+        }
+
+        static bool print(VM *vm, CallFrame *, const uint8_t *) {
+            vm->pop().print();
+            printf("\n");
+            return true;
+        }
+
+        static bool setUpvalue(VM *vm, CallFrame *frame, const uint8_t *ip) {
+            ObjUpvalue *upvalue = frame->closure->upvalues[ip[1]];
+            *upvalue->location = vm->peek(0);
+            writeBarrier(upvalue, vm->peek(0));
+            return true;
+        }
+
+        static bool getProperty(VM *vm, CallFrame *frame, const uint8_t *ip) {
+            if (!IS_INSTANCE(vm->peek(0))) return false;
+            ObjInstance *instance = AS_INSTANCE(vm->peek(0));
+            Chunk *chunk = frame->closure->function->chunk;
+            ObjString *name = AS_STRING(chunk->constants[ip[1]]);
+            InlineCache *cache = &chunk->caches[(ip[2] << 8) | ip[3]];
+
+            Value value;
+            bool isField;
+            if (!vm->findProperty(instance, name, cache, &value, &isField)) return false;
+            if (isField) {
+                vm->pop();
+                vm->push(value);
+            } else {
+                ObjBoundMethod *bound = newBoundMethod(vm->peek(0), AS_CLOSURE(value));
+                vm->pop();
+                vm->push(OBJ_VAL(bound));
+            }
+            return true;
+        }
+
+        static bool getLocalProperty(VM *vm, CallFrame *frame, const uint8_t *ip) {
+            Value receiver = frame->slots[ip[1]];
+            if (!IS_INSTANCE(receiver)) return false;
+            ObjInstance *instance = AS_INSTANCE(receiver);
+            Chunk *chunk = frame->closure->function->chunk;
+            ObjString *name = AS_STRING(chunk->constants[ip[2]]);
+            InlineCache *cache = &chunk->caches[(ip[3] << 8) | ip[4]];
+
+            Value value;
+            bool isField;
+            if (!vm->findProperty(instance, name, cache, &value, &isField)) return false;
+            if (isField) {
+                vm->push(value);
+            } else {
+                vm->push(OBJ_VAL(newBoundMethod(receiver, AS_CLOSURE(value))));
+            }
+            return true;
+        }
+
+        static bool setProperty(VM *vm, CallFrame *frame, const uint8_t *ip) {
+            if (!IS_INSTANCE(vm->peek(1))) return false;
+            ObjInstance *instance = AS_INSTANCE(vm->peek(1));
+            Chunk *chunk = frame->closure->function->chunk;
+            ObjString *name = AS_STRING(chunk->constants[ip[1]]);
+            vm->setProperty(instance, name, vm->peek(0), &chunk->caches[(ip[2] << 8) | ip[3]]);
+            Value value = vm->pop();
+            vm->pop();
+            vm->push(value);
+            return true;
+        }
+
+        static bool getSuper(VM *vm, CallFrame *frame, const uint8_t *ip) {
+            Chunk *chunk = frame->closure->function->chunk;
+            ObjString *name = AS_STRING(chunk->constants[ip[1]]);
+            Value method;
+            if (!vm->findMethod(AS_CLASS(vm->peek(0)), name, &chunk->caches[(ip[2] << 8) | ip[3]], &method)) {
+                return false;
+            }
+            vm->pop();
+            ObjBoundMethod *bound = newBoundMethod(vm->peek(0), AS_CLOSURE(method));
+            vm->pop();
+            vm->push(OBJ_VAL(bound));
+            return true;
+        }
+
+        static bool closeUpvalue(VM *vm, CallFrame *, const uint8_t *) {
+            vm->closeUpvalues(vm->stackTop - 1);
+            vm->pop();
+            return true;
+        }
+
+        static bool safepoint(VM *vm, CallFrame *frame, const uint8_t *ip) {
+            if (vm->profileTick && vm->profiler != nullptr) {
+                // 采样要用帧的ip找行号 指向这条OP_LOOP之后
+                frame->ip = (uint8_t *) ip + 3;
+                vm->profiler->sample(vm);
+            }
+            gcSafepoint();
+            return true;
+        }
+    };
+
+    // 成员在对象中的偏移 对象类型有基类 不能用offsetof
+    template<typename T, typename M>
+    static int32_t fieldOffset(M T::*member) {
+        T probe{};
+        return (int32_t) ((uint8_t *) &(probe.*member) - (uint8_t *) &probe);
+    }
+
+    // 把一个函数的字节码翻译成机器码
+    class JitCompiler {
+    public:
+        JitCompiler(VM *vm, ObjFunction *function) : chunk(function->chunk), epilogue(0) {
+            auto *base = (uint8_t *) vm;
+            stackTopOffset = (int32_t) ((uint8_t *) &vm->stackTop - base);
+            globalsOffset = (int32_t) ((uint8_t *) &vm->globals - base);
+            nurseryPendingOffset = (int32_t) ((uint8_t *) &vm->nurseryPending - base);
+            bytesAllocatedOffset = (int32_t) ((uint8_t *) &vm->bytesAllocated - base);
+            nextSliceOffset = (int32_t) ((uint8_t *) &vm->nextSlice - base);
+            profileTickOffset = (int32_t) ((uint8_t *) &vm->profileTick - base);
+        }
+
+        JitCode *compile() {
+            int count = (int) chunk->code.size();
+            std::vector<uint32_t> entries(count, JIT_NO_ENTRY);
+            emitPrologue();
+
+            for (int offset = 0; offset < count; offset += chunk->instructionLength(offset)) {
+                entries[offset] = (uint32_t) masm.size();
+                emitInstruction(offset);
+            }
+
+            for (auto &jump: jumps) masm.patch(jump.first, entries[jump.second]);
+            // 类型检查失败的出口放在末尾 每条指令一个
+            std::vector<size_t> stubs(count, 0);
+            for (auto &exit: exits) {
+                if (stubs[exit.second] == 0) {
+                    stubs[exit.second] = masm.size();
+                    emitExit(exit.second);
+                }
+                masm.patch(exit.first, stubs[exit.second]);
+            }
+
+            size_t size = (masm.size() + 4095) & ~(size_t) 4095;
+            void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (memory == MAP_FAILED) return nullptr;
+            memcpy(memory, masm.code.data(), masm.size());
+            if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+                munmap(memory, size);
+                return nullptr;
+            }
+
+            auto *jit = new JitCode();
+            jit->code = (uint8_t *) memory;
+            jit->size = size;
+            jit->entries = new uint32_t[count];
+            std::copy(entries.begin(), entries.end(), jit->entries);
+            return jit;
+        }
+
+    private:
+        Chunk *chunk;
+        Assembler masm;
+        size_t epilogue;                                // 恢复寄存器并返回的代码
+        std::vector<std::pair<size_t, int>> jumps;      // 待回填的跳转和目标字节码偏移
+        std::vector<std::pair<size_t, int>> exits;      // 待回填的跳转和退出处的字节码偏移
+        int32_t stackTopOffset;
+        int32_t globalsOffset;
+        int32_t nurseryPendingOffset;
+        int32_t bytesAllocatedOffset;
+        int32_t nextSliceOffset;
+        int32_t profileTickOffset;
+
+        // 保存寄存器 载入虚拟机状态后跳到目标指令
+        void emitPrologue() {
+            masm.push(R12);
+            masm.push(R13);
+            masm.push(R14);
+            masm.push(R15);
+            // 调用回调时栈要16字节对齐
+            masm.subImmediate(RSP, 8);
+            masm.move(R13, RDI);
+            masm.move(R15, RSI);
+            masm.load(R14, R15, offsetof(CallFrame, slots));
+            masm.load(R12, R13, stackTopOffset);
+            masm.jumpIndirect(RDX);
+
+            epilogue = masm.size();
+            masm.addImmediate(RSP, 8);
+            masm.pop(R15);
+            masm.pop(R14);
+            masm.pop(R13);
+            masm.pop(R12);
+            masm.ret();
+        }
+
+        // 写回ip和栈顶后返回解释器 解释器从offset处的指令继续
+        void emitExit(int offset) {
+            masm.moveImmediate(RAX, (uint64_t) (chunk->code.data() + offset));
+            masm.store(R15, offsetof(CallFrame, ip), RAX);
+            masm.store(R13, stackTopOffset, R12);
+            masm.patch(masm.jump(), epilogue);
+        }
+
+        void exitIf(Condition condition, int offset) {
+            exits.emplace_back(masm.jump(condition), offset);
+        }
+
+        // 栈顶往下第distance个值不是数字时退出
+        void checkNumber(int distance, int offset) {
+            masm.compareInt32(R12, -16 * (distance + 1), VAL_NUMBER);
+            exitIf(CC_NE, offset);
+        }
+
+        // 调用运行时回调 前后同步栈顶 canFail时回调返回false就退出
+        void callHelper(JitHelper helper, int offset, bool canFail) {
+            masm.store(R13, stackTopOffset, R12);
+            masm.move(RDI, R13);
+            masm.move(RSI, R15);
+            masm.moveImmediate(RDX, (uint64_t) (chunk->code.data() + offset));
+            masm.moveImmediate(RAX, (uint64_t) helper);
+            masm.callIndirect(RAX);
+            masm.load(R12, R13, stackTopOffset);
+            if (canFail) {
+                masm.testByte(RAX);
+                exitIf(CC_E, offset);
+            }
+        }
+
+        void pushImmediate(ValueType type, int32_t payload) {
+            masm.storeImmediate(R12, 0, type, false);
+            masm.storeImmediate(R12, 8, payload, true);
+            masm.addImmediate(R12, 16);
+        }
+
+        // 弹出两个数字 把al中的比较结果作为布尔值压栈
+        void pushComparison() {
+            masm.storeImmediate(R12, -32, VAL_BOOL, false);
+            masm.storeByte(R12, -24, RAX);
+            masm.subImmediate(R12, 16);
+        }
+
+        // 栈顶往上disp处的值为nil或false时跳到字节码target处
+        void emitFalsyJump(int32_t disp, int target) {
+            masm.compareInt32(R12, disp, VAL_NIL);
+            jumps.emplace_back(masm.jump(CC_E), target);
+            masm.compareInt32(R12, disp, VAL_BOOL);
+            size_t truthy = masm.jump(CC_NE);
+            masm.compareByte(R12, disp + 8, 0);
+            jumps.emplace_back(masm.jump(CC_E), target);
+            masm.patch(truthy, masm.size());
+        }
+
+        // 弹出两个值 把是否相等作为布尔值压栈 数字直接比较 其它交给回调
+        void emitEqual(int offset) {
+            masm.compareInt32(R12, -16, VAL_NUMBER);
+            size_t slow = masm.jump(CC_NE);
+            masm.compareInt32(R12, -32, VAL_NUMBER);
+            size_t slow2 = masm.jump(CC_NE);
+            // 相等且不是NaN
+            masm.loadDouble(XMM0, R12, -24);
+            masm.loadDouble(XMM1, R12, -8);
+            masm.compareDouble(XMM0, XMM1);
+            masm.set(CC_E, RAX);
+            masm.set(CC_NP, RCX);
+            masm.andByte(RAX, RCX);
+            pushComparison();
+            size_t done = masm.jump();
+            masm.patch(slow, masm.size());
+            masm.patch(slow2, masm.size());
+            callHelper(JitRuntime::equal, offset, false);
+            masm.patch(done, masm.size());
+        }
+
+        void emitBinary(uint8_t opcode) {
+            masm.loadDouble(XMM0, R12, -24);
+            masm.arithmetic(opcode, XMM0, R12, -8);
+            masm.storeDouble(R12, -24, XMM0);
+            masm.subImmediate(R12, 16);
+        }
+
+        void emitInstruction(int offset) {
+            uint8_t *ip = chunk->code.data() + offset;
+            // 只有三字节的指令才读取两字节操作数
+            uint16_t operand = chunk->instructionLength(offset) >= 3 ? (ip[1] << 8) | ip[2] : 0;
+            switch (ip[0]) {
+                case OP_CONSTANT: {
+                    Value constant = chunk->constants[ip[1]];
+                    if (IS_NUMBER(constant)) {
+                        double number = AS_NUMBER(constant);
+                        uint64_t bits;
+                        memcpy(&bits, &number, sizeof(bits));
+                        masm.storeImmediate(R12, 0, VAL_NUMBER, false);
+                        masm.moveImmediate(RAX, bits);
+                        masm.store(R12, 8, RAX);
+                        masm.addImmediate(R12, 16);
+                    } else {
+                        // 对象常量会随新生代回收移动 每次从常量表读取
+                        masm.moveImmediate(RAX, (uint64_t) &chunk->constants[ip[1]]);
+                        masm.loadValue(XMM0, RAX, 0);
+                        masm.storeValue(R12, 0, XMM0);
+                        masm.addImmediate(R12, 16);
+                    }
+                    break;
+                }
+                case OP_NIL:
+                    pushImmediate(VAL_NIL, 0);
+                    break;
+                case OP_TRUE:
+                    pushImmediate(VAL_BOOL, 1);
+                    break;
+                case OP_FALSE:
+                    pushImmediate(VAL_BOOL, 0);
+                    break;
+                case OP_POP:
+                    masm.subImmediate(R12, 16);
+                    break;
+                case OP_GET_LOCAL:
+                    masm.loadValue(XMM0, R14, ip[1] * 16);
+                    masm.storeValue(R12, 0, XMM0);
+                    masm.addImmediate(R12, 16);
+                    break;
+                case OP_SET_LOCAL:
+                    masm.loadValue(XMM0, R12, -16);
+                    masm.storeValue(R14, ip[1] * 16, XMM0);
+                    break;
+                case OP_GET_GLOBAL:
+                    // 槽位数组会在编译新代码时扩容 每次从虚拟机读取
+                    masm.load(RAX, R13, globalsOffset);
+                    masm.compareInt32(RAX, operand * 16, VAL_UNDEFINED);
+                    exitIf(CC_E, offset);
+                    masm.loadValue(XMM0, RAX, operand * 16);
+                    masm.storeValue(R12, 0, XMM0);
+                    masm.addImmediate(R12, 16);
+                    break;
+                case OP_DEFINE_GLOBAL:
+                    masm.load(RAX, R13, globalsOffset);
+                    masm.loadValue(XMM0, R12, -16);
+                    masm.storeValue(RAX, operand * 16, XMM0);
+                    masm.subImmediate(R12, 16);
+                    break;
+                case OP_SET_GLOBAL:
+                    masm.load(RAX, R13, globalsOffset);
+                    masm.compareInt32(RAX, operand * 16, VAL_UNDEFINED);
+                    exitIf(CC_E, offset);
+                    masm.loadValue(XMM0, R12, -16);
+                    masm.storeValue(RAX, operand * 16, XMM0);
+                    break;
+                case OP_GET_UPVALUE:
+                    masm.load(RAX, R15, offsetof(CallFrame, closure));
+                    masm.load(RAX, RAX, fieldOffset(&ObjClosure::upvalues));
+                    masm.load(RAX, RAX, ip[1] * 8);
+                    masm.load(RAX, RAX, fieldOffset(&ObjUpvalue::location));
+                    masm.loadValue(XMM0, RAX, 0);
+                    masm.storeValue(R12, 0, XMM0);
+                    masm.addImmediate(R12, 16);
+                    break;
+                case OP_SET_UPVALUE:
+                    callHelper(JitRuntime::setUpvalue, offset, false);
+                    break;
+                case OP_GET_PROPERTY:
+                    callHelper(JitRuntime::getProperty, offset, true);
+                    break;
+                case OP_GET_LOCAL_PROPERTY:
+                    callHelper(JitRuntime::getLocalProperty, offset, true);
+                    break;
+                case OP_ADD_LOCAL_CONSTANT:
+                    masm.compareInt32(R14, ip[1] * 16, VAL_NUMBER);
+                    exitIf(CC_NE, offset);
+                    masm.loadDouble(XMM0, R14, ip[1] * 16 + 8);
+                    masm.moveImmediate(RAX, (uint64_t) &chunk->constants[ip[2]]);
+                    masm.arithmetic(0x58, XMM0, RAX, 8);
+                    masm.storeDouble(R14, ip[1] * 16 + 8, XMM0);
+                    break;
+                case OP_SET_PROPERTY:
+                    callHelper(JitRuntime::setProperty, offset, true);
+                    break;
+                case OP_GET_SUPER:
+                    callHelper(JitRuntime::getSuper, offset, true);
+                    break;
+                case OP_EQUAL:
+                    emitEqual(offset);
+                    break;
+                case OP_GREATER:
+                case OP_LESS:
+                case OP_GREATER_NUMBER:
+                case OP_LESS_NUMBER:
+                    checkNumber(0, offset);
+                    checkNumber(1, offset);
+                    masm.loadDouble(XMM0, R12, -24);
+                    masm.loadDouble(XMM1, R12, -8);
+                    // 无序时CF和ZF都为1 seta得到false
+                    if (ip[0] == OP_GREATER || ip[0] == OP_GREATER_NUMBER) {
+                        masm.compareDouble(XMM0, XMM1);
+                    } else {
+                        masm.compareDouble(XMM1, XMM0);
+                    }
+                    masm.set(CC_A, RAX);
+                    pushComparison();
+                    break;
+                case OP_ADD:
+                case OP_ADD_NUMBER: {
+                    // 特化过的加法仍保留拼接回调 多态的调用点不会反复退出到解释器
+                    masm.compareInt32(R12, -16, VAL_NUMBER);
+                    size_t slow = masm.jump(CC_NE);
+                    masm.compareInt32(R12, -32, VAL_NUMBER);
+                    size_t slow2 = masm.jump(CC_NE);
+                    emitBinary(0x58);
+                    size_t done = masm.jump();
+                    masm.patch(slow, masm.size());
+                    masm.patch(slow2, masm.size());
+                    callHelper(JitRuntime::add, offset, true);
+                    masm.patch(done, masm.size());
+                    break;
+                }
+                case OP_SUBTRACT:
+                case OP_MULTIPLY:
+                case OP_DIVIDE:
+                case OP_SUBTRACT_NUMBER:
+                case OP_MULTIPLY_NUMBER:
+                case OP_DIVIDE_NUMBER:
+                    checkNumber(0, offset);
+                    checkNumber(1, offset);
+                    emitBinary(ip[0] == OP_SUBTRACT || ip[0] == OP_SUBTRACT_NUMBER ? 0x5C :
+                               ip[0] == OP_MULTIPLY || ip[0] == OP_MULTIPLY_NUMBER ? 0x59 : 0x5E);
+                    break;
+                case OP_NOT:
+                    callHelper(JitRuntime::negateTruth, offset, false);
+                    break;
+                case OP_NEGATE:
+                    checkNumber(0, offset);
+                    masm.load(RAX, R12, -8);
+                    masm.flipSign(RAX);
+                    masm.store(R12, -8, RAX);
+                    break;
+                case OP_PRINT:
+                    callHelper(JitRuntime::print, offset, false);
+                    break;
+                case OP_JUMP:
+                    jumps.emplace_back(masm.jump(), offset + 3 + operand);
+                    break;
+                case OP_JUMP_IF_FALSE:
+                    // nil和false为假 不弹出条件
+                    emitFalsyJump(-16, offset + 3 + operand);
+                    break;
+                case OP_POP_JUMP_IF_FALSE:
+                    // 弹出后条件仍在原来的内存中
+                    masm.subImmediate(R12, 16);
+                    emitFalsyJump(0, offset + 3 + operand);
+                    break;
+                case OP_EQUAL_JUMP_IF_FALSE:
+                    emitEqual(offset);
+                    masm.subImmediate(R12, 16);
+                    emitFalsyJump(0, offset + 3 + operand);
+                    break;
+                case OP_GREATER_JUMP_IF_FALSE:
+                case OP_LESS_JUMP_IF_FALSE:
+                    checkNumber(0, offset);
+                    checkNumber(1, offset);
+                    masm.loadDouble(XMM0, R12, -24);
+                    masm.loadDouble(XMM1, R12, -8);
+                    masm.subImmediate(R12, 32);
+                    // 不大于或无序时跳转 先减栈顶 比较的标志位留给跳转
+                    if (ip[0] == OP_GREATER_JUMP_IF_FALSE) {
+                        masm.compareDouble(XMM0, XMM1);
+                    } else {
+                        masm.compareDouble(XMM1, XMM0);
+                    }
+                    jumps.emplace_back(masm.jump(CC_BE), offset + 3 + operand);
+                    break;
+                case OP_LOOP: {
+                    // 安全点 与解释器的SAFEPOINT条件相同 包括采样标记
+                    masm.compareByte(R13, nurseryPendingOffset, 0);
+                    size_t collect = masm.jump(CC_NE);
+                    masm.load(RAX, R13, bytesAllocatedOffset);
+                    masm.compare(RAX, R13, nextSliceOffset);
+                    size_t collect2 = masm.jump(CC_AE);
+                    masm.compareInt32(R13, profileTickOffset, 0);
+                    size_t sample = masm.jump(CC_NE);
+                    jumps.emplace_back(masm.jump(), offset + 3 - operand);
+                    masm.patch(collect, masm.size());
+                    masm.patch(collect2, masm.size());
+                    masm.patch(sample, masm.size());
+                    callHelper(JitRuntime::safepoint, offset, false);
+                    jumps.emplace_back(masm.jump(), offset + 3 - operand);
+                    break;
+                }
+                case OP_CLOSE_UPVALUE:
+                    callHelper(JitRuntime::closeUpvalue, offset, false);
+                    break;
+                default:
+                    // 调用 返回 闭包和类相关的指令交给解释器
+                    emitExit(offset);
+                    break;
+            }
+        }
+    };
+
+    void jitCompile(VM *vm, ObjFunction *function) {
+        if (function->jit != nullptr) return;
+        JitCompiler compiler(vm, function);
+        function->jit = compiler.compile();
+    }
+
+    void jitEnter(VM *vm, CallFrame *frame) {
+        JitCode *jit = frame->closure->function->jit;
+        uint32_t entry = jit->entries[frame->ip - frame->closure->function->chunk->code.data()];
+        if (entry == JIT_NO_ENTRY) return;
+        ((JitEntry) jit->code)(vm, frame, jit->code + entry);
+    }
+
+    void jitFree(JitCode *jit) {
+        munmap(jit->code, jit->size);
+        delete[] jit->entries;
+        delete jit;
+    }
+
+}
+
+#endif
@@ -0,0 +1,42 @@
+//
+// Created by hlx on 2023/10/4.
+//
+
+#ifndef CPPLOX_JIT_H
+#define CPPLOX_JIT_H
+
+#include "common.h"
+#include "object.h"
+
+namespace cpplox {
+
+    class VM;
+    struct CallFrame;
+
+    // 函数被调用和循环回跳累计这么多次后编译成机器码
+    const uint32_t JIT_THRESHOLD = 1000;
+
+    // 函数编译出的机器码
+    // 开头是进入机器码的公共入口 每条字节码指令各有一个入口 可以从任意指令处进入
+    struct JitCode {
+        uint8_t *code;          // 可执行内存 单独映射
+        size_t size;            // 映射的字节数
+        uint32_t *entries;      // 字节码偏移到机器码偏移的映射 不是指令开头的为JIT_NO_ENTRY
+    };
+
+    const uint32_t JIT_NO_ENTRY = UINT32_MAX;
+
+    // 把函数的字节码逐条按模板翻译成x86-64机器码 已编译或映射内存失败时什么也不做
+    // 数字运算 局部和全局变量 跳转直接生成机器码 字符串拼接 属性访问 安全点等回调运行时
+    // 调用 返回 建类等指令以及类型检查失败时退出到解释器 由解释器执行这条指令
+    void jitCompile(VM *vm, ObjFunction *function);
+
+    // 从帧的ip处进入机器码 退出时帧的ip指向需要解释器执行的指令 虚拟机栈顶已同步
+    void jitEnter(VM *vm, CallFrame *frame);
+
+    // 释放函数的机器码
+    void jitFree(JitCode *jit);
+
+}
+
+#endif //CPPLOX_JIT_H
@@ -4,15 +4,52 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <thread>
+#include <vector>
 
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "bytecode.h"
+#include "compiler.h"
+#include "jit.h"
+#include "profiler.h"
 #include "vm.h"
 
 namespace cpplox{
+    // 命令行选项 每个虚拟机按它初始化
+    struct Options {
+        size_t gcPauseBudget = 0;                   // 增量回收每次暂停的预算 微秒
+        size_t stackInitial = STACK_INITIAL;        // 虚拟机栈初始容量 单位为值
+        size_t stackLimit = STACK_MAX;              // 虚拟机栈容量上限
+        size_t framesInitial = FRAMES_INITIAL;      // 栈帧数组初始容量
+        size_t framesLimit = FRAMES_MAX;            // 栈帧数上限
+        bool cache = false;                         // 使用源码旁的字节码缓存 过期时重新编译并写入
+        bool emit = false;                          // 只编译并写出字节码 不执行
+        bool jit = true;                            // 把热点函数编译成机器码
+        size_t jitThreshold = JIT_THRESHOLD;        // 函数编译前的调用和循环回跳次数
+        bool jitCompare = false;                    // 分别关闭和开启JIT运行 比较两次的输出
+        bool registers = false;                     // 翻译成寄存器代码执行 不用JIT
+        long profileInterval = 0;                   // 采样分析的间隔 微秒 为0时不分析
+    };
+
+    // 按选项初始化虚拟机
+    static void setupVM(VM *machine, const Options &options) {
+        initVM(machine);
+        machine->gcPauseBudget = options.gcPauseBudget;
+        machine->jitEnabled = options.jit && !options.registers;
+        machine->registerEnabled = options.registers;
+        machine->jitThreshold = options.jitThreshold > 0 ? (uint32_t) options.jitThreshold : 1;
+        machine->configureStack(options.stackInitial, options.stackLimit,
+                                (int) options.framesInitial, (int) options.framesLimit);
+    }
+
     // 命令模式 最长为1024
-    static void repl() {
+    static void repl(VM *machine) {
         char line[1024];
         for (;;) {
             printf("> ");
@@ -22,7 +59,7 @@ namespace cpplox{
                 break;
             }
 
-            vm.interpret(line);
+            machine->interpret(line);
         }
     }
 
@@ -35,31 +72,223 @@ namespace cpplox{
         return buffer.str();
     }
 
-    // 用传入的文件路径读取文件 并解释执行
-    static void runFile(const char* path) {
-        std::string source = readFile(path);
-        InterpretResult result = vm.interpret(source.c_str());
+    // 编译源码 按选项读写字节码缓存 编译错误返回nullptr
+    static ObjFunction *compileFile(const Options &options, const char *path, const std::string &source) {
+        uint64_t hash = hashSource(source.data(), source.size());
+        std::string cachePath = bytecodePath(path);
+        if (!options.emit) {
+            ObjFunction *function = readBytecode(cachePath.c_str(), true, hash);
+            if (function != nullptr) return function;
+        }
+
+        ObjFunction *function = compile(source.c_str());
+        if (function != nullptr && !writeBytecode(function, hash, cachePath.c_str()) && options.emit) {
+            fprintf(stderr, "Could not write bytecode \"%s\".\n", cachePath.c_str());
+        }
+        return function;
+    }
+
+    // 是否为字节码文件 直接执行 不检查源码
+    static bool isBytecodeFile(const char *path) {
+        size_t length = strlen(path);
+        return length >= 5 && strcmp(path + length - 5, ".loxc") == 0;
+    }
+
+    // 分析结果写在脚本旁边 x.lox对应x.prof和x.folded
+    static void writeProfile(Profiler *profiler, const char *path) {
+        std::string base(path);
+        if (base.size() >= 4 && base.compare(base.size() - 4, 4, ".lox") == 0) base.resize(base.size() - 4);
+
+        std::string reportPath = base + ".prof";
+        std::string foldedPath = base + ".folded";
+        FILE *report = fopen(reportPath.c_str(), "w");
+        FILE *folded = fopen(foldedPath.c_str(), "w");
+        if (report == nullptr || folded == nullptr) {
+            fprintf(stderr, "Could not write profile \"%s\".\n", reportPath.c_str());
+        } else {
+            profiler->writeReport(report);
+            profiler->writeFolded(folded);
+        }
+        if (report != nullptr) fclose(report);
+        if (folded != nullptr) fclose(folded);
+    }
+
+    // 用传入的文件路径读取文件 在独立的虚拟机中解释执行 返回退出码
+    static int runFile(const Options &options, const char* path) {
+        VM machine;
+        setupVM(&machine, options);
+        Profiler profiler(options.profileInterval);
+        if (options.profileInterval > 0 && !profiler.start(&machine)) {
+            fprintf(stderr, "Could not start profiler.\n");
+        }
+
+        InterpretResult result;
+        if (isBytecodeFile(path)) {
+            ObjFunction *function = readBytecode(path, false, 0);
+            if (function == nullptr) {
+                fprintf(stderr, "Could not load bytecode \"%s\".\n", path);
+                freeVM(&machine);
+                return 74;
+            }
+            result = machine.interpret(function);
+        } else if (options.cache || options.emit) {
+            ObjFunction *function = compileFile(options, path, readFile(path));
+            if (function == nullptr) {
+                result = InterpretResult::COMPILE_ERROR;
+            } else if (options.emit) {
+                result = InterpretResult::OK;
+            } else {
+                result = machine.interpret(function);
+            }
+        } else {
+            std::string source = readFile(path);
+            result = machine.interpret(source.c_str());
+        }
+        if (options.profileInterval > 0) {
+            profiler.stop();
+            writeProfile(&profiler, path);
+        }
+        freeVM(&machine);
+
+        if (result == InterpretResult::COMPILE_ERROR) return 65;
+        if (result == InterpretResult::RUNTIME_ERROR) return 70;
+        return 0;
+    }
+
+    // 在子进程中按选项运行脚本 收集标准输出和标准错误 返回退出码
+    static int captureRun(const Options &options, const char *path, std::string *output) {
+        fflush(stdout);
+        fflush(stderr);
+        int fds[2];
+        if (pipe(fds) != 0) return -1;
+        pid_t pid = fork();
+        if (pid < 0) {
+            close(fds[0]);
+            close(fds[1]);
+            return -1;
+        }
+        if (pid == 0) {
+            close(fds[0]);
+            dup2(fds[1], STDOUT_FILENO);
+            dup2(fds[1], STDERR_FILENO);
+            close(fds[1]);
+            int code = runFile(options, path);
+            fflush(stdout);
+            _exit(code);
+        }
+
+        close(fds[1]);
+        char buffer[4096];
+        ssize_t count;
+        while ((count = read(fds[0], buffer, sizeof(buffer))) > 0) output->append(buffer, count);
+        close(fds[0]);
+        int status;
+        if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status)) return -1;
+        return WEXITSTATUS(status);
+    }
+
+    // 分别关闭和开启JIT运行脚本 输出JIT一侧的结果 输出或退出码不一致时报告第一处不同
+    static int compareJit(Options options, const char *path) {
+        std::string interpreted, compiled;
+        options.jit = false;
+        int interpretedCode = captureRun(options, path, &interpreted);
+        options.jit = true;
+        int compiledCode = captureRun(options, path, &compiled);
+        fwrite(compiled.data(), 1, compiled.size(), stdout);
+        fflush(stdout);
+
+        if (interpreted == compiled && interpretedCode == compiledCode) return compiledCode;
+        size_t at = 0;
+        int line = 1;
+        while (at < interpreted.size() && at < compiled.size() && interpreted[at] == compiled[at]) {
+            if (interpreted[at++] == '\n') line++;
+        }
+        fprintf(stderr, "JIT mismatch in \"%s\": output differs at line %d, exit code %d vs %d.\n",
+                path, line, interpretedCode, compiledCode);
+        return 1;
+    }
 
-        if (result == InterpretResult::COMPILE_ERROR) exit(65);
-        if (result == InterpretResult::RUNTIME_ERROR) exit(70);
+    // 解析"初始容量[,上限]" 没有上限时上限不变
+    static void parseSizes(const char *arg, size_t *initial, size_t *limit) {
+        char *end;
+        *initial = strtoul(arg, &end, 10);
+        if (*end == ',') *limit = strtoul(end + 1, nullptr, 10);
     }
 }
 
 
 
 int main(int argc, const char *argv[]) {
-    cpplox::initVM();
+    cpplox::Options options;
 
-    // 启动参数校验  一个参数为指令模式  两个参数为文件模式
-    if (argc == 1) {
-        cpplox::repl(); // 指令模式
-    } else if (argc == 2) {
-        cpplox::runFile(argv[1]);   // 文件模式
-    } else {
-        fprintf(stderr, "Usage: cpplox [path]\n");
-        exit(64);
+    // 启动参数校验  选项之后没有路径为指令模式  有路径为文件模式
+    std::vector<const char *> paths;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--gc-pause=", 11) == 0) {
+            options.gcPauseBudget = strtoul(argv[i] + 11, nullptr, 10);
+        } else if (strncmp(argv[i], "--stack=", 8) == 0) {
+            cpplox::parseSizes(argv[i] + 8, &options.stackInitial, &options.stackLimit);
+        } else if (strncmp(argv[i], "--frames=", 9) == 0) {
+            cpplox::parseSizes(argv[i] + 9, &options.framesInitial, &options.framesLimit);
+        } else if (strcmp(argv[i], "--cache") == 0) {
+            options.cache = true;
+        } else if (strcmp(argv[i], "--emit") == 0) {
+            options.emit = true;
+        } else if (strcmp(argv[i], "--no-jit") == 0) {
+            options.jit = false;
+        } else if (strncmp(argv[i], "--jit-threshold=", 16) == 0) {
+            options.jitThreshold = strtoul(argv[i] + 16, nullptr, 10);
+        } else if (strcmp(argv[i], "--jit-compare") == 0) {
+            options.jitCompare = true;
+        } else if (strcmp(argv[i], "--register") == 0) {
+            options.registers = true;
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            options.profileInterval = cpplox::PROFILE_INTERVAL;
+        } else if (strncmp(argv[i], "--profile=", 10) == 0) {
+            options.profileInterval = strtol(argv[i] + 10, nullptr, 10);
+        } else if (argv[i][0] != '-') {
+            paths.push_back(argv[i]);
+        } else {
+            fprintf(stderr, "Usage: cpplox [--gc-pause=us] [--stack=n[,max]] [--frames=n[,max]] [--cache] [--emit] "
+                            "[--no-jit] [--jit-threshold=n] [--jit-compare] [--register] [--profile[=us]] [path...]\n");
+            exit(64);
+        }
+    }
+
+    if (paths.empty()) {
+        cpplox::VM machine;
+        cpplox::setupVM(&machine, options);
+        cpplox::repl(&machine); // 指令模式
+        cpplox::freeVM(&machine);
+        return 0;
+    }
+
+    // 比较模式在子进程中逐个运行 不开线程
+    if (options.jitCompare) {
+        int status = 0;
+        for (const char *path: paths) {
+            int result = cpplox::compareJit(options, path);
+            if (result > status) status = result;
+        }
+        return status;
+    }
+
+    if (paths.size() == 1) {
+        return cpplox::runFile(options, paths[0]);   // 文件模式
     }
 
-    cpplox::freeVM();
-    return 0;
+    // 多个文件时每个文件一个线程 各自使用独立的虚拟机 退出码取最大的
+    std::vector<int> results(paths.size());
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < paths.size(); i++) {
+        threads.emplace_back([&options, &paths, &results, i] {
+            results[i] = cpplox::runFile(options, paths[i]);
+        });
+    }
+    int status = 0;
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i].join();
+        if (results[i] > status) status = results[i];
+    }
+    return status;
 }
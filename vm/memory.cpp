@@ -1 +1,672 @@
-//// Created by hlx on 2023/10/4.//#include "compiler.h"#include "memory.h"#include "vm.h"#ifdef DEBUG_LOG_GC#include <stdio.h>#include "debug.h"#endifnamespace cpplox {#define GC_HEAP_GROW_FACTOR 2    void compute(size_t oldSize, size_t newSize) {        vm.bytesAllocated += newSize - oldSize;        if (newSize > oldSize) {#ifdef DEBUG_STRESS_GC            collectGarbage();#endif            if (vm.bytesAllocated > vm.nextGC) {                collectGarbage();            }        }    }    void markObject(Obj *object) {        if (object == nullptr) return;        if (object->isMarked) return;#ifdef DEBUG_LOG_GC        printf("%p mark ", (void *) object);        OBJ_VAL(object).print();        printf("\n");#endif        object->isMarked = true;        if (vm.grayCapacity < vm.grayCount + 1) {            vm.grayCapacity = GROW_CAPACITY(vm.grayCapacity);            vm.grayStack = (Obj **) realloc(vm.grayStack, sizeof(Obj *) * vm.grayCapacity);            if (vm.grayStack == nullptr) exit(1);        }        vm.grayStack[vm.grayCount++] = object;    }    void markValue(Value value) {        if (IS_OBJ(value)) markObject(AS_OBJ(value));    }    // 标记数组    static void markArray(ValueArray& array) {        for (int i = 0; i < array.size(); i++) {            markValue(array[i]);        }    }// 置黑对象    static void blackenObject(Obj *object) {#ifdef DEBUG_LOG_GC        printf("%p blacken ", (void *) object);        OBJ_VAL(object).print();        printf("\n");#endif        switch (object->type) {            case OBJ_BOUND_METHOD: {                auto *bound = (ObjBoundMethod *) object;                markValue(bound->receiver);                markObject((Obj *) bound->method);                break;            }            case OBJ_CLASS: {                auto *klass = (ObjClass *) object;                markObject((Obj *) klass->name);                markTable(klass->methods);                break;            }            case OBJ_CLOSURE: {                auto *closure = (ObjClosure *) object;                markObject((Obj *) closure->function);                for (int i = 0; i < closure->upvalueCount; i++) {                    markObject((Obj *) closure->upvalues[i]);                }                break;            }            case OBJ_FUNCTION: {                auto *function = (ObjFunction *) object;                markObject((Obj *) function->name);                markArray(function->chunk->constants);                break;            }            case OBJ_INSTANCE: {                auto *instance = (ObjInstance *) object;                markObject((Obj *) instance->klass);                markTable(instance->fields);                break;            }            case OBJ_UPVALUE:                markValue(((ObjUpvalue *) object)->closed);                break;            case OBJ_NATIVE:            case OBJ_STRING:                break;        }    }// 释放对象    static void freeObject(Obj *object) {#ifdef DEBUG_LOG_GC        printf("%p free type %d\n", (void *) object, object->type);#endif        switch (object->type) {            case OBJ_BOUND_METHOD:                FREE(ObjBoundMethod, (ObjBoundMethod *) object);                break;            case OBJ_CLASS: {                auto *klass = (ObjClass *) object;                delete klass->methods;                FREE(ObjClass, klass);                break;            }            case OBJ_CLOSURE: {                auto *closure = (ObjClosure *) object;                FREE_ARRAY(ObjUpvalue*, closure->upvalues, closure->upvalueCount);                FREE(ObjClosure, closure);                break;            }            case OBJ_FUNCTION: {                auto *function = (ObjFunction *) object;                delete function->chunk;                FREE(ObjFunction, function);                break;            }            case OBJ_INSTANCE: {                auto *instance = (ObjInstance *) object;                delete instance->fields;                FREE(ObjInstance, instance);                break;            }            case OBJ_NATIVE:                FREE(ObjNative, (ObjNative *) object);                break;            case OBJ_STRING: {                auto *string = (ObjString *) object;                compute(string->chars->capacity(), 0);                delete string->chars;                FREE(ObjString, string);                break;            }            case OBJ_UPVALUE:                FREE(ObjUpvalue, (ObjUpvalue *) object);                break;        }    }// 标记根对象    static void markRoots() {        // 标记虚拟机栈        for (Value *slot = vm.stack; slot < vm.stackTop; slot++) {            markValue(*slot);        }        // 闭包        for (int i = 0; i < vm.frameCount; i++) {            markObject((Obj *) vm.frames[i].closure);        }        // 提升值        for (ObjUpvalue *upvalue = vm.openUpvalues;             upvalue != nullptr;             upvalue = upvalue->next) {            markObject((Obj *) upvalue);        }        // 全局变量        markTable(&vm.globals);        markCompilerRoots();        markObject((Obj *) vm.initString);    }// 跟踪对象    static void traceReferences() {        while (vm.grayCount > 0) {            Obj *object = vm.grayStack[--vm.grayCount];            blackenObject(object);        }    }// 清扫    static void sweep() {        Obj *previous = nullptr;        Obj *object = vm.objects;        while (object != nullptr) {            if (object->isMarked) {                object->isMarked = false;                previous = object;                object = object->next;            } else {                Obj *unreached = object;                object = object->next;                if (previous != nullptr) {                    previous->next = object;                } else {                    vm.objects = object;                }                freeObject(unreached);            }        }    }    void collectGarbage() {#ifdef DEBUG_LOG_GC        printf("-- gc begin\n");        size_t before = vm.bytesAllocated;#endif        markRoots();        traceReferences();        tableRemoveWhite(&vm.strings);        sweep();        vm.nextGC = vm.bytesAllocated * GC_HEAP_GROW_FACTOR;#ifdef DEBUG_LOG_GC        printf("-- gc end\n");        printf("   collected %zu bytes (from %zu to %zu) next at %zu\n",               before - vm.bytesAllocated, before, vm.bytesAllocated,               vm.nextGC);#endif    }    void freeObjects() {        Obj *object = vm.objects;        while (object != nullptr) {            Obj *next = object->next;            freeObject(object);            object = next;        }        free(vm.grayStack);    }}
\ No newline at end of file
+//
+// Created by hlx on 2023/10/4.
+//
+
+
+
+#include <chrono>
+#include <cstring>
+
+#include "compiler.h"
+#include "jit.h"
+#include "memory.h"
+#include "register.h"
+#include "vm.h"
+
+#ifdef DEBUG_LOG_GC
+
+#include <stdio.h>
+#include "debug.h"
+
+#endif
+
+namespace cpplox {
+
+
+#define GC_HEAP_GROW_FACTOR 2
+// 增量回收期间每分配这么多字节推进一次
+#define GC_SLICE_STEP (64 * 1024)
+// 增量回收每处理这么多对象检查一次是否超出暂停预算
+#define GC_CLOCK_INTERVAL 64
+
+    // 按需启动或推进一次回收
+    static void maybeCollect() {
+#ifdef DEBUG_STRESS_GC
+        bool due = true;
+#else
+        bool due = (vm->gcPhase == GcPhase::IDLE && vm->bytesAllocated > vm->nextGC) ||
+                   vm->bytesAllocated >= vm->nextSlice;
+#endif
+        if (!due) return;
+
+        if (vm->gcPauseBudget == 0) {
+            collectGarbage();
+        } else {
+            collectIncrementally();
+        }
+    }
+
+    void compute(size_t oldSize, size_t newSize) {
+        vm->bytesAllocated += newSize - oldSize;
+        if (newSize > oldSize) {
+            maybeCollect();
+        }
+    }
+
+    // 标灰 放进灰色栈等待扫描
+    static void grayObject(Obj *object) {
+        object->isMarked = true;
+
+        if (vm->grayCapacity < vm->grayCount + 1) {
+            vm->grayCapacity = GROW_CAPACITY(vm->grayCapacity);
+            vm->grayStack = (Obj **) realloc(vm->grayStack, sizeof(Obj *) * vm->grayCapacity);
+
+            if (vm->grayStack == nullptr) exit(1);
+        }
+
+        vm->grayStack[vm->grayCount++] = object;
+    }
+
+    void markObject(Obj *object) {
+        if (object == nullptr) return;
+        if (object->isMarked) return;
+        // 新生代对象不标记 老年代回收结束前统一扫描整个新生代
+        if (isYoung(object)) return;
+#ifdef DEBUG_LOG_GC
+        printf("%p mark ", (void *) object);
+        OBJ_VAL(object).print();
+        printf("\n");
+#endif
+        grayObject(object);
+    }
+
+    void markAllocated(Obj *object) {
+        if (vm->gcPhase == GcPhase::MARK) grayObject(object);
+    }
+
+    void markValue(Value value) {
+        if (IS_OBJ(value)) markObject(AS_OBJ(value));
+    }
+
+    // 标记数组
+    static void markArray(ValueArray& array) {
+        for (int i = 0; i < array.size(); i++) {
+            markValue(array[i]);
+        }
+    }
+
+// 置黑对象
+    static void blackenObject(Obj *object) {
+#ifdef DEBUG_LOG_GC
+        printf("%p blacken ", (void *) object);
+        OBJ_VAL(object).print();
+        printf("\n");
+#endif
+        switch (object->type) {
+            case OBJ_BOUND_METHOD: {
+                auto *bound = (ObjBoundMethod *) object;
+                markValue(bound->receiver);
+                markObject((Obj *) bound->method);
+                break;
+            }
+            case OBJ_CLASS: {
+                auto *klass = (ObjClass *) object;
+                markObject((Obj *) klass->name);
+                markTable(klass->methods);
+                break;
+            }
+            case OBJ_CLOSURE: {
+                auto *closure = (ObjClosure *) object;
+                markObject((Obj *) closure->function);
+                for (int i = 0; i < closure->upvalueCount; i++) {
+                    markObject((Obj *) closure->upvalues[i]);
+                }
+                break;
+            }
+            case OBJ_FUNCTION: {
+                auto *function = (ObjFunction *) object;
+                markObject((Obj *) function->name);
+                markArray(function->chunk->constants);
+                // 寄存器代码有常量表的副本
+                if (function->registers != nullptr) {
+                    for (Value &constant: function->registers->constants) markValue(constant);
+                }
+                // 内联缓存持有类和方法
+                for (InlineCache &cache: function->chunk->caches) {
+                    for (int i = 0; i < cache.count; i++) {
+                        markObject((Obj *) cache.entries[i].klass);
+                        markValue(cache.entries[i].method);
+                    }
+                }
+                break;
+            }
+            case OBJ_INSTANCE: {
+                auto *instance = (ObjInstance *) object;
+                markObject((Obj *) instance->klass);
+                if (instance->shape != nullptr) {
+                    Value *slots = instance->slots();
+                    for (int i = 0; i < instance->shape->slotCount; i++) {
+                        markValue(slots[i]);
+                    }
+                } else {
+                    markTable(instance->fields);
+                }
+                break;
+            }
+            case OBJ_UPVALUE:
+                markValue(((ObjUpvalue *) object)->closed);
+                break;
+            case OBJ_BUILDER:
+            case OBJ_NATIVE:
+            case OBJ_STRING:
+                break;
+        }
+    }
+
+    size_t objectSize(Obj *object) {
+        switch (object->type) {
+            case OBJ_BOUND_METHOD:
+                return sizeof(ObjBoundMethod);
+            case OBJ_BUILDER:
+                return sizeof(ObjBuilder);
+            case OBJ_CLASS:
+                return sizeof(ObjClass);
+            case OBJ_CLOSURE:
+                return sizeof(ObjClosure);
+            case OBJ_FUNCTION:
+                return sizeof(ObjFunction);
+            case OBJ_INSTANCE:
+                return instanceSize((ObjInstance *) object);
+            case OBJ_NATIVE:
+                return sizeof(ObjNative);
+            case OBJ_STRING:
+                return stringSize(((ObjString *) object)->length);
+            case OBJ_UPVALUE:
+                return sizeof(ObjUpvalue);
+        }
+        return 0; // Unreachable.
+    }
+
+// 释放对象持有的其它内存 不释放对象本身
+    static void releaseObject(Obj *object) {
+        switch (object->type) {
+            case OBJ_BUILDER: {
+                StringBuffer *buffer = ((ObjBuilder *) object)->buffer;
+                if (--buffer->refCount == 0) {
+                    reallocate<uint8_t>((uint8_t *) buffer, sizeof(StringBuffer) + buffer->capacity, 0);
+                }
+                break;
+            }
+            case OBJ_CLASS:
+                delete ((ObjClass *) object)->methods;
+                break;
+            case OBJ_CLOSURE: {
+                auto *closure = (ObjClosure *) object;
+                FREE_ARRAY(ObjUpvalue*, closure->upvalues, closure->upvalueCount);
+                break;
+            }
+            case OBJ_FUNCTION:
+                delete ((ObjFunction *) object)->chunk;
+                delete ((ObjFunction *) object)->registers;
+#ifdef JIT
+                if (((ObjFunction *) object)->jit != nullptr) jitFree(((ObjFunction *) object)->jit);
+#endif
+                break;
+            case OBJ_INSTANCE: {
+                auto *instance = (ObjInstance *) object;
+                delete instance->fields;
+                if (instance->overflow != nullptr) {
+                    FREE_ARRAY(Value, instance->overflow, instance->overflowCapacity);
+                }
+                break;
+            }
+            case OBJ_BOUND_METHOD:
+            case OBJ_NATIVE:
+            case OBJ_STRING:
+            case OBJ_UPVALUE:
+                break;
+        }
+    }
+
+// 释放老年代对象
+    static void freeObject(Obj *object) {
+#ifdef DEBUG_LOG_GC
+        printf("%p free type %d\n", (void *) object, object->type);
+#endif
+        size_t size = objectSize(object);
+        releaseObject(object);
+        reallocate<uint8_t>((uint8_t *) object, size, 0);
+    }
+
+// 标记形状树上的字段名
+    static void markShape(Shape *shape) {
+        markObject((Obj *) shape->key);
+        for (auto &item: shape->transitions) {
+            markShape(item.second);
+        }
+    }
+
+// 标记根对象
+    static void markRoots() {
+        // 标记虚拟机栈
+        for (Value *slot = vm->stack; slot < vm->stackTop; slot++) {
+            markValue(*slot);
+        }
+
+        // 闭包
+        for (int i = 0; i < vm->frameCount; i++) {
+            markObject((Obj *) vm->frames[i].closure);
+        }
+
+        // 提升值
+        for (ObjUpvalue *upvalue = vm->openUpvalues;
+             upvalue != nullptr;
+             upvalue = upvalue->next) {
+            markObject((Obj *) upvalue);
+        }
+
+        // 全局变量
+        markTable(&vm->globalNames);
+        for (int i = 0; i < vm->globalCount; i++) {
+            markValue(vm->globals[i]);
+        }
+        markCompilerRoots();
+        markObject((Obj *) vm->initString);
+        markShape(vm->rootShape);
+    }
+
+// 跟踪对象
+    static void traceReferences() {
+        while (vm->grayCount > 0) {
+            Obj *object = vm->grayStack[--vm->grayCount];
+            blackenObject(object);
+        }
+    }
+
+// 扫描新生代中的全部对象 标记它们引用的老年代对象
+// 死亡的新生代对象也扫描 保证新生代对象引用的老年代对象不会先被释放
+    static void markNursery() {
+        for (uint8_t *cursor = vm->nursery; cursor < vm->nurseryTop;) {
+            auto *object = (Obj *) cursor;
+            cursor += alignObjectSize(objectSize(object));
+            blackenObject(object);
+        }
+    }
+
+    // 记忆集只保留存活的对象 在清扫前调用
+    static void sweepRememberedSet() {
+        int count = 0;
+        for (int i = 0; i < vm->rememberedCount; i++) {
+            Obj *object = vm->rememberedSet[i];
+            if (object->isMarked) {
+                vm->rememberedSet[count++] = object;
+            }
+        }
+        vm->rememberedCount = count;
+    }
+
+// 开始标记 标记根对象
+    static void beginMarking() {
+#ifdef DEBUG_LOG_GC
+        printf("-- gc begin\n");
+#endif
+        vm->gcPhase = GcPhase::MARK;
+        markRoots();
+    }
+
+// 结束标记 重新标记没有写屏障的根 然后处理弱引用 准备清扫
+    static void finishMarking() {
+        markRoots();
+        markNursery();
+        traceReferences();
+        tableRemoveWhite(&vm->strings);
+        sweepRememberedSet();
+
+        // 清扫期间新分配的对象串在vm->objects上 不会被这一轮清扫
+        vm->sweepList = vm->objects;
+        vm->objects = nullptr;
+        vm->gcPhase = GcPhase::SWEEP;
+    }
+
+// 清扫一个对象 存活的对象清除标记后放回根链表
+    static void sweepObject() {
+        Obj *object = vm->sweepList;
+        vm->sweepList = object->next;
+        if (object->isMarked) {
+            object->isMarked = false;
+            object->next = vm->objects;
+            vm->objects = object;
+        } else {
+            freeObject(object);
+        }
+    }
+
+// 结束一轮回收
+    static void finishSweeping() {
+        vm->gcPhase = GcPhase::IDLE;
+        vm->nextSlice = SIZE_MAX;
+        vm->nextGC = vm->bytesAllocated * GC_HEAP_GROW_FACTOR;
+
+#ifdef DEBUG_LOG_GC
+        printf("-- gc end\n");
+        printf("   %zu bytes allocated next at %zu\n", vm->bytesAllocated, vm->nextGC);
+#endif
+    }
+
+    void collectGarbage() {
+        // 先完成进行中的增量回收 它的标记可能已经过时
+        if (vm->gcPhase == GcPhase::MARK) finishMarking();
+        while (vm->sweepList != nullptr) sweepObject();
+
+        beginMarking();
+        traceReferences();
+        finishMarking();
+        while (vm->sweepList != nullptr) sweepObject();
+        finishSweeping();
+    }
+
+    void collectIncrementally() {
+        using Clock = std::chrono::steady_clock;
+        Clock::time_point deadline = Clock::now() + std::chrono::microseconds(vm->gcPauseBudget);
+        bool exhausted = false;
+
+        if (vm->gcPhase == GcPhase::IDLE) {
+            beginMarking();
+            vm->nextSlice = vm->bytesAllocated;
+        }
+
+        // 标记切片 灰色对象处理完后结束标记
+        if (vm->gcPhase == GcPhase::MARK) {
+            int count = 0;
+            while (vm->grayCount > 0) {
+                blackenObject(vm->grayStack[--vm->grayCount]);
+                if (++count % GC_CLOCK_INTERVAL == 0 && Clock::now() >= deadline) {
+                    exhausted = true;
+                    break;
+                }
+            }
+            // 结束标记时要扫描整个新生代 尽量等到新生代回收后再结束 那时新生代是空的
+            if (vm->grayCount == 0) {
+                if (vm->nurseryTop == vm->nursery || vm->bytesAllocated > vm->nextGC * GC_HEAP_GROW_FACTOR) {
+                    finishMarking();
+                } else {
+                    vm->nurseryPending = true;
+                }
+            }
+        }
+
+        // 清扫切片
+        if (vm->gcPhase == GcPhase::SWEEP) {
+            int count = 0;
+            while (vm->sweepList != nullptr) {
+                sweepObject();
+                if (++count % GC_CLOCK_INTERVAL == 0 && Clock::now() >= deadline) {
+                    exhausted = true;
+                    break;
+                }
+            }
+            if (vm->sweepList == nullptr) finishSweeping();
+        }
+
+        // 每个切片偿还GC_SLICE_STEP字节的分配 用完预算时欠下的分配留给后面的切片
+        // 分配得比回收快时切片会更频繁 保证一轮回收能结束
+        if (vm->gcPhase == GcPhase::IDLE) {
+            vm->nextSlice = SIZE_MAX;
+        } else if (exhausted) {
+            vm->nextSlice += GC_SLICE_STEP;
+        } else {
+            vm->nextSlice = vm->bytesAllocated + GC_SLICE_STEP;
+        }
+    }
+
+    void gcSafepoint() {
+        if (vm->nurseryPending) {
+            collectNursery();
+        } else if (vm->bytesAllocated >= vm->nextSlice) {
+            collectIncrementally();
+        }
+    }
+
+    void rememberObject(Obj *object) {
+        if (object->isRemembered || isYoung(object)) return;
+        object->isRemembered = true;
+
+        if (vm->rememberedCapacity < vm->rememberedCount + 1) {
+            vm->rememberedCapacity = GROW_CAPACITY(vm->rememberedCapacity);
+            vm->rememberedSet = (Obj **) realloc(vm->rememberedSet, sizeof(Obj *) * vm->rememberedCapacity);
+
+            if (vm->rememberedSet == nullptr) exit(1);
+        }
+
+        vm->rememberedSet[vm->rememberedCount++] = object;
+    }
+
+// 把新生代对象复制到老年代 原对象记下新地址 复制品串在根链表头部等待扫描
+    static Obj *promoteObject(Obj *object) {
+        size_t size = objectSize(object);
+        // 晋升不触发gc 只计入已分配内存
+        auto *copy = (Obj *) vm->pool.allocate(size);
+        if (copy == nullptr) exit(1);
+        vm->bytesAllocated += size;
+        memcpy(copy, object, size);
+
+        copy->isMarked = false;
+        copy->isRemembered = false;
+        copy->next = vm->objects;
+        vm->objects = copy;
+
+        // 关闭的提升值指向自己的closed字段
+        if (object->type == OBJ_UPVALUE) {
+            auto *upvalue = (ObjUpvalue *) object;
+            if (upvalue->location == &upvalue->closed) {
+                ((ObjUpvalue *) copy)->location = &((ObjUpvalue *) copy)->closed;
+            }
+        }
+
+        object->isMarked = true;
+        object->next = copy;
+
+        // 增量标记期间晋升的对象标灰 它可能引用还没标记的老年代对象
+        if (vm->gcPhase == GcPhase::MARK) markObject(copy);
+
+#ifdef DEBUG_LOG_GC
+        printf("%p promote to %p\n", (void *) object, (void *) copy);
+#endif
+        return copy;
+    }
+
+// 把指向新生代对象的引用改为晋升后的地址
+    template<typename T>
+    static void forwardObject(T **slot) {
+        Obj *object = (Obj *) *slot;
+        if (object == nullptr || !isYoung(object)) return;
+        *slot = (T *) (object->isMarked ? object->next : promoteObject(object));
+    }
+
+    static void forwardValue(Value *slot) {
+        Value value = *slot;
+        if (!isYoungValue(value)) return;
+        Obj *object = AS_OBJ(value);
+        *slot = OBJ_VAL(object->isMarked ? object->next : promoteObject(object));
+    }
+
+    static void forwardTable(Table *table) {
+        for (int i = 0; i < table->capacity; i++) {
+            Entry *entry = &table->entries[i];
+            forwardObject(&entry->key);
+            forwardValue(&entry->value);
+        }
+    }
+
+    static void forwardShape(Shape *shape) {
+        forwardObject(&shape->key);
+        for (auto &item: shape->transitions) {
+            forwardObject(&item.first);
+            forwardShape(item.second);
+        }
+    }
+
+// 扫描老年代对象的字段 晋升其引用的新生代对象
+    static void scanObject(Obj *object) {
+        switch (object->type) {
+            case OBJ_BOUND_METHOD: {
+                auto *bound = (ObjBoundMethod *) object;
+                forwardValue(&bound->receiver);
+                forwardObject(&bound->method);
+                break;
+            }
+            case OBJ_CLASS: {
+                auto *klass = (ObjClass *) object;
+                forwardObject(&klass->name);
+                forwardTable(klass->methods);
+                break;
+            }
+            case OBJ_CLOSURE: {
+                auto *closure = (ObjClosure *) object;
+                forwardObject(&closure->function);
+                for (int i = 0; i < closure->upvalueCount; i++) {
+                    forwardObject(&closure->upvalues[i]);
+                }
+                break;
+            }
+            case OBJ_FUNCTION: {
+                auto *function = (ObjFunction *) object;
+                forwardObject(&function->name);
+                ValueArray &constants = function->chunk->constants;
+                for (size_t i = 0; i < constants.size(); i++) {
+                    forwardValue(&constants[i]);
+                }
+                if (function->registers != nullptr) {
+                    for (Value &constant: function->registers->constants) forwardValue(&constant);
+                }
+                for (InlineCache &cache: function->chunk->caches) {
+                    for (int i = 0; i < cache.count; i++) {
+                        forwardObject(&cache.entries[i].klass);
+                        forwardValue(&cache.entries[i].method);
+                    }
+                }
+                break;
+            }
+            case OBJ_INSTANCE: {
+                auto *instance = (ObjInstance *) object;
+                forwardObject(&instance->klass);
+                if (instance->shape != nullptr) {
+                    Value *slots = instance->slots();
+                    for (int i = 0; i < instance->shape->slotCount; i++) {
+                        forwardValue(&slots[i]);
+                    }
+                } else {
+                    forwardTable(instance->fields);
+                }
+                break;
+            }
+            case OBJ_UPVALUE:
+                // 打开的提升值链表由根单独处理 关闭后的next不再使用
+                forwardValue(&((ObjUpvalue *) object)->closed);
+                break;
+            case OBJ_BUILDER:
+            case OBJ_NATIVE:
+            case OBJ_STRING:
+                break;
+        }
+    }
+
+    void collectNursery() {
+#ifdef DEBUG_LOG_GC
+        printf("-- minor gc begin\n");
+        size_t before = vm->bytesAllocated;
+#endif
+        // 晋升的对象依次串在根链表头部 scanned之前的都是已扫描过的
+        Obj *scanned = vm->objects;
+
+        // 根
+        for (Value *slot = vm->stack; slot < vm->stackTop; slot++) {
+            forwardValue(slot);
+        }
+        for (int i = 0; i < vm->frameCount; i++) {
+            forwardObject(&vm->frames[i].closure);
+        }
+        for (ObjUpvalue **upvalue = &vm->openUpvalues; *upvalue != nullptr; upvalue = &(*upvalue)->next) {
+            forwardObject(upvalue);
+        }
+        forwardTable(&vm->globalNames);
+        for (int i = 0; i < vm->globalCount; i++) {
+            forwardValue(&vm->globals[i]);
+        }
+        forwardObject(&vm->initString);
+        forwardShape(vm->rootShape);
+
+        // 记忆集中的老年代对象
+        for (int i = 0; i < vm->rememberedCount; i++) {
+            Obj *object = vm->rememberedSet[i];
+            object->isRemembered = false;
+            scanObject(object);
+        }
+        vm->rememberedCount = 0;
+
+        // 晋升的对象可能还引用新生代对象
+        while (vm->objects != scanned) {
+            Obj *first = vm->objects;
+            for (Obj *object = first; object != scanned; object = object->next) {
+                scanObject(object);
+            }
+            scanned = first;
+        }
+
+        // 字符串表是弱引用 没晋升的字符串移出表
+        for (int i = 0; i < vm->strings.capacity; i++) {
+            Entry *entry = &vm->strings.entries[i];
+            if (entry->key == nullptr || !isYoung(entry->key)) continue;
+            if (entry->key->isMarked) {
+                entry->key = (ObjString *) entry->key->next;
+            } else {
+                vm->strings.remove(entry->key);
+            }
+        }
+
+        // 释放死亡对象持有的内存 然后清空新生代
+        for (uint8_t *cursor = vm->nursery; cursor < vm->nurseryTop;) {
+            auto *object = (Obj *) cursor;
+            cursor += alignObjectSize(objectSize(object));
+            if (!object->isMarked) releaseObject(object);
+        }
+        vm->nurseryTop = vm->nursery;
+        vm->nurseryPending = false;
+
+#ifdef DEBUG_LOG_GC
+        printf("-- minor gc end\n");
+        printf("   promoted %zu bytes\n", vm->bytesAllocated - before);
+#endif
+
+        // 新生代已清空 是结束增量标记的时机
+        if (vm->gcPhase == GcPhase::MARK && vm->grayCount == 0) {
+            collectIncrementally();
+            return;
+        }
+        // 晋升的对象计入了老年代 可能需要启动或推进老年代回收
+        maybeCollect();
+    }
+
+    void freeObjects() {
+        for (Obj *list: {vm->objects, vm->sweepList}) {
+            Obj *object = list;
+            while (object != nullptr) {
+                Obj *next = object->next;
+                freeObject(object);
+                object = next;
+            }
+        }
+        vm->objects = nullptr;
+        vm->sweepList = nullptr;
+
+        for (uint8_t *cursor = vm->nursery; cursor < vm->nurseryTop;) {
+            auto *nurseryObject = (Obj *) cursor;
+            cursor += alignObjectSize(objectSize(nurseryObject));
+            releaseObject(nurseryObject);
+        }
+        vm->nurseryTop = vm->nursery;
+
+        free(vm->grayStack);
+        free(vm->rememberedSet);
+    }
+}
@@ -1 +1,131 @@
-//// Created by hlx on 2023/10/4.//#ifndef CPPLOX_MEMORY_H#define CPPLOX_MEMORY_H#include <cstdlib>#include "common.h"#include "object.h"namespace cpplox{// 初始分配内存#define ALLOCATE(type, count) reallocate<type>(nullptr, 0, count)// 动态数组扩容 小于8则初始化为8 否则则容量乘2#define GROW_CAPACITY(capacity) ((capacity) < 8 ? 8 : (capacity) * 2)// 释放数组#define FREE_ARRAY(type, pointer, oldCount) reallocate<type>(pointer, oldCount, 0)// 释放对象#define FREE(type, pointer) reallocate<type>(pointer, 1, 0)    void compute(size_t oldSize, size_t newSize);    // 重新分配内存 扩容或者缩容 取决于新旧长度的大小    template<typename T>    T *reallocate(T *pointer, size_t oldSize, size_t newSize) {        oldSize = oldSize * sizeof(T);        newSize = newSize * sizeof(T);        compute(oldSize, newSize);        // 新长度为0是 释放该指针 返回null        if (newSize == 0) {            free(pointer);            return nullptr;        }        // 新长度非0时 c底层会重分配        T *result = (T *) realloc(pointer, newSize);        if (result == nullptr) exit(1);    // 计算机内存不足时 退出抛出异常码1        return result;    }    // 标记对象    void markObject(Obj* object);// 标记值    void markValue(Value value);// 执行一次垃圾回收    void collectGarbage();// 释放虚拟机根链的对象    void freeObjects();}#endif //CPPLOX_MEMORY_H
\ No newline at end of file
+//
+// Created by hlx on 2023/10/4.
+//
+
+#ifndef CPPLOX_MEMORY_H
+#define CPPLOX_MEMORY_H
+
+#include <cstdlib>
+#include "common.h"
+#include "object.h"
+#include "vm.h"
+
+namespace cpplox{
+
+
+// 初始分配内存
+#define ALLOCATE(type, count) reallocate<type>(nullptr, 0, count)
+
+// 动态数组扩容 小于8则初始化为8 否则则容量乘2
+#define GROW_CAPACITY(capacity) ((capacity) < 8 ? 8 : (capacity) * 2)
+
+// 数组扩容到newCount 计入gc统计的已分配字节数
+#define GROW_ARRAY(type, pointer, oldCount, newCount) reallocate<type>(pointer, oldCount, newCount)
+
+// 释放数组
+#define FREE_ARRAY(type, pointer, oldCount) reallocate<type>(pointer, oldCount, 0)
+
+// 释放对象
+#define FREE(type, pointer) reallocate<type>(pointer, 1, 0)
+
+    void compute(size_t oldSize, size_t newSize);
+
+    // 重新分配内存 扩容或者缩容 取决于新旧长度的大小
+    template<typename T>
+    T *reallocate(T *pointer, size_t oldSize, size_t newSize) {
+        oldSize = oldSize * sizeof(T);
+        newSize = newSize * sizeof(T);
+
+        compute(oldSize, newSize);
+
+        // 新长度为0是 释放该指针 返回null
+        if (newSize == 0) {
+            vm->pool.free(pointer, oldSize);
+            return nullptr;
+        }
+
+        // 新长度非0时 小块由内存池按尺寸类别分配 大块交给c底层重分配
+        T *result = (T *) vm->pool.reallocate(pointer, oldSize, newSize);
+        if (result == nullptr) exit(1);    // 计算机内存不足时 退出抛出异常码1
+        return result;
+    }
+
+    // 新生代中分配的最大对象 更大的对象直接分配到老年代
+    const size_t NURSERY_MAX_OBJECT = NURSERY_SIZE / 8;
+
+    // 对象大小按8字节对齐 新生代中的对象依次紧密排列
+    static inline size_t alignObjectSize(size_t size) {
+        return (size + 7) & ~(size_t) 7;
+    }
+
+    // 在新生代中碰撞分配 放不下时返回nullptr 由调用者分配到老年代
+    static inline Obj *nurseryAllocate(size_t size) {
+        size = alignObjectSize(size);
+        if (size > NURSERY_MAX_OBJECT) return nullptr;
+#ifdef DEBUG_STRESS_GC
+        vm->nurseryPending = true;
+#endif
+        if (size > (size_t) (vm->nurseryEnd - vm->nurseryTop)) {
+            vm->nurseryPending = true;
+            return nullptr;
+        }
+        auto *object = (Obj *) vm->nurseryTop;
+        vm->nurseryTop += size;
+        return object;
+    }
+
+    // 是否为新生代对象
+    static inline bool isYoung(Obj *object) {
+        return (uint8_t *) object >= vm->nursery && (uint8_t *) object < vm->nurseryEnd;
+    }
+
+    // 是否为新生代对象的值
+    static inline bool isYoungValue(Value value) {
+        return IS_OBJ(value) && isYoung(AS_OBJ(value));
+    }
+
+    // 老年代对象加入记忆集 新生代回收时它的字段作为根
+    void rememberObject(Obj *object);
+
+    // 标记对象
+    void markObject(Obj* object);
+
+    // 写屏障 在owner的字段中写入value后调用
+    // 老年代对象引用新生代对象时加入记忆集 增量标记期间把写入的老年代对象标灰
+    static inline void writeBarrier(Obj *owner, Value value) {
+        if (!IS_OBJ(value)) return;
+        Obj *object = AS_OBJ(value);
+        if (isYoung(object)) {
+            if (!owner->isRemembered && !isYoung(owner)) rememberObject(owner);
+        } else if (vm->gcPhase == GcPhase::MARK && !object->isMarked) {
+            markObject(object);
+        }
+    }
+
+    // 增量标记期间新分配到老年代的对象标灰 调用者初始化字段后才会被扫描
+    void markAllocated(Obj *object);
+
+    // 对象占用的字节数
+    size_t objectSize(Obj *object);
+
+// 标记值
+    void markValue(Value value);
+
+// 执行一次完整的垃圾回收 一次暂停完成
+    void collectGarbage();
+
+// 推进一次增量回收 标记或清扫直到用完暂停预算
+    void collectIncrementally();
+
+// 解释器安全点 回收新生代或推进增量回收
+    void gcSafepoint();
+
+// 新生代回收 把存活对象晋升到老年代后清空新生代
+// 会移动对象 只能在解释器安全点调用 此时虚拟机根之外没有指向对象的裸指针
+    void collectNursery();
+
+// 释放虚拟机根链的对象
+    void freeObjects();
+}
+
+#endif //CPPLOX_MEMORY_H
@@ -3,6 +3,7 @@
 //
 
 #include <cstdio>
+#include <cstring>
 #include <utility>
 
 #include "memory.h"
@@ -14,21 +15,32 @@
 namespace cpplox {
 
 // 分配对象
-#define ALLOCATE_OBJ(type, objectType) (type*)allocateObject<type>(objectType)
+#define ALLOCATE_OBJ(type, objectType) (type*)allocateObject(sizeof(type), objectType)
 
-    // 分配对象
-    template<typename T>
-    static Obj *allocateObject(ObjType type) {
-        Obj *object = reallocate<T>(nullptr, 0, 1);
-        object->type = type;
-        object->isMarked = false;
-
-        // 串进虚拟机根链表中
-        object->next = vm.objects;
-        vm.objects = object;
+    // 分配对象 size包含对象尾部的变长部分
+    static Obj *allocateObject(size_t size, ObjType type) {
+        // 先在新生代碰撞分配 新生代中的对象不在根链表中
+        Obj *object = nurseryAllocate(size);
+        if (object != nullptr) {
+            object->type = type;
+            object->isMarked = false;
+            object->isRemembered = false;
+            object->next = nullptr;
+        } else {
+            // 新生代已满或对象太大 直接分配到老年代 串进虚拟机根链表中
+            object = (Obj *) reallocate<uint8_t>(nullptr, 0, size);
+            object->type = type;
+            object->isMarked = false;
+            object->isRemembered = false;
+            object->next = vm->objects;
+            vm->objects = object;
+            // 随后写入的字段可能引用新生代对象或还没标记的对象
+            rememberObject(object);
+            markAllocated(object);
+        }
 
 #ifdef DEBUG_LOG_GC
-        printf("%p allocate %zu for %d\n", (void *) object, sizeof(T), type);
+        printf("%p allocate %zu for %d\n", (void *) object, size, type);
 #endif
         return object;
     }
@@ -44,6 +56,8 @@ namespace cpplox {
         auto *klass = ALLOCATE_OBJ(ObjClass, OBJ_CLASS);
         klass->name = name;
         klass->methods = new Table();
+        klass->version = 0;
+        klass->slotHint = 0;
         return klass;
     }
 
@@ -66,82 +80,246 @@ namespace cpplox {
         function->arity = 0;
         function->upvalueCount = 0;
         function->name = nullptr;
+        function->hotness = 0;
+        function->jit = nullptr;
+        function->registers = nullptr;
         function->chunk = new Chunk();
         return function;
     }
 
     ObjInstance *newInstance(ObjClass *klass) {
-        auto *instance = ALLOCATE_OBJ(ObjInstance, OBJ_INSTANCE);
+        // 按该类实例以往的字段数预留内联槽位
+        int capacity = klass->slotHint;
+        auto *instance = (ObjInstance *) allocateObject(sizeof(ObjInstance) + sizeof(Value) * capacity,
+                                                        OBJ_INSTANCE);
         instance->klass = klass;
-        instance->fields = new Table();
+        instance->shape = vm->rootShape;
+        instance->fields = nullptr;
+        instance->overflow = nullptr;
+        instance->capacity = capacity;
+        instance->overflowCapacity = 0;
         return instance;
     }
 
+    bool instanceGet(ObjInstance *instance, ObjString *name, Value *value) {
+        if (instance->shape == nullptr) {
+            return instance->fields->get(name, value);
+        }
+
+        int slot = instance->shape->lookup(name);
+        if (slot == -1) return false;
+        *value = instance->slots()[slot];
+        return true;
+    }
+
+    void instanceReserve(ObjInstance *instance, int count) {
+        if (instance->overflow == nullptr && count <= instance->capacity) return;
+        if (instance->overflow != nullptr && count <= instance->overflowCapacity) return;
+
+        int oldCapacity = instance->overflowCapacity;
+        int newCapacity = GROW_CAPACITY(oldCapacity > instance->capacity ? oldCapacity : instance->capacity);
+        while (newCapacity < count) newCapacity = GROW_CAPACITY(newCapacity);
+
+        // 先分配再切换 gc期间实例仍指向旧的槽位
+        Value *overflow = reallocate<Value>(instance->overflow, oldCapacity, newCapacity);
+        if (instance->overflow == nullptr) {
+            for (int i = 0; i < instance->shape->slotCount; i++) {
+                overflow[i] = instance->inlineSlots[i];
+            }
+        }
+        instance->overflow = overflow;
+        instance->overflowCapacity = newCapacity;
+    }
+
+    void instanceSet(ObjInstance *instance, ObjString *name, Value value) {
+        writeBarrier(instance, value);
+        if (instance->shape == nullptr) {
+            instance->fields->set(name, value);
+            return;
+        }
+
+        Shape *shape = instance->shape;
+        int slot = shape->lookup(name);
+        if (slot != -1) {
+            instance->slots()[slot] = value;
+            return;
+        }
+
+        // 字段过多 转为字典模式
+        if (shape->slotCount >= SHAPE_MAX_SLOTS) {
+            auto *fields = new Table();
+            Value *slots = instance->slots();
+            for (Shape *item = shape; item->parent != nullptr; item = item->parent) {
+                fields->set(item->key, slots[item->slotCount - 1]);
+            }
+            fields->set(name, value);
+
+            if (instance->overflow != nullptr) {
+                FREE_ARRAY(Value, instance->overflow, instance->overflowCapacity);
+                instance->overflow = nullptr;
+                instance->overflowCapacity = 0;
+            }
+            instance->fields = fields;
+            instance->shape = nullptr;
+            return;
+        }
+
+        instanceReserve(instance, shape->slotCount + 1);
+        Shape *next = shape->transition(name);
+        instance->slots()[next->slotCount - 1] = value;
+        instance->shape = next;
+
+        if (next->slotCount > instance->klass->slotHint) {
+            instance->klass->slotHint = next->slotCount;
+        }
+    }
+
+    size_t instanceSize(ObjInstance *instance) {
+        return sizeof(ObjInstance) + sizeof(Value) * instance->capacity;
+    }
+
+    Shape::Shape(Shape *parent, ObjString *key) {
+        this->parent = parent;
+        this->key = key;
+        this->slotCount = parent == nullptr ? 0 : parent->slotCount + 1;
+    }
+
+    int Shape::lookup(ObjString *name) {
+        for (Shape *shape = this; shape->parent != nullptr; shape = shape->parent) {
+            if (shape->key == name) return shape->slotCount - 1;
+        }
+        return -1;
+    }
+
+    Shape *Shape::transition(ObjString *name) {
+        for (auto &item: this->transitions) {
+            if (item.first == name) return item.second;
+        }
+
+        auto *shape = new Shape(this, name);
+        this->transitions.emplace_back(name, shape);
+        return shape;
+    }
+
+    Shape::~Shape() {
+        for (auto &item: this->transitions) {
+            delete item.second;
+        }
+    }
+
     ObjNative *newNative(NativeFn function) {
         auto *native = ALLOCATE_OBJ(ObjNative, OBJ_NATIVE);
         native->function = function;
         return native;
     }
 
-    // 分配字符串
-    static ObjString *allocateString(std::string chars) {
-        auto *string = ALLOCATE_OBJ(ObjString, OBJ_STRING);
-        string->chars = new std::string(std::move(chars));
-
-        vm.push(OBJ_VAL(string));
-        vm.strings[string] = NIL_VAL;
-        vm.pop();
-        return string;
+    // 加入全局字符串表
+    static void internString(ObjString *string) {
+        vm->push(OBJ_VAL(string));
+        vm->strings.set(string, NIL_VAL);
+        vm->pop();
     }
 
-    ObjString *takeString(std::string chars) {
-        ObjString key{};
-        std::string str(std::move(chars));
-        key.chars = &str;
-        // 如果在全局字符串中匹配到了   则释放这个用全局的字符串
-        auto iter = vm.strings.find(&key);
-        if (iter != vm.strings.end()) {
-            // 析构char时计算
-            compute(str.capacity(), 0);
-            return iter->first;
+    // FNV-1a 初始值
+    static const uint32_t FNV_OFFSET_BASIS = 2166136261u;
+
+    // FNV-1a 字符串哈希 从hash继续计算 可以分段哈希
+    static uint32_t hashString(const char *key, int length, uint32_t hash) {
+        for (int i = 0; i < length; i++) {
+            hash ^= (uint8_t) key[i];
+            hash *= 16777619;
         }
+        return hash;
+    }
 
-        return allocateString(std::move(str));
+    size_t stringSize(int length) {
+        return sizeof(ObjString) + length + 1;
     }
 
-    ObjString *copyString(const std::string& chars) {
-        ObjString key{};
-        std::string str(chars);
-        key.chars = &str;
+    ObjString *copyString(const char *chars, int length) {
+        uint32_t hash = hashString(chars, length, FNV_OFFSET_BASIS);
         // 全局存在则直接用全局的
-        auto iter = vm.strings.find(&key);
-        if (iter != vm.strings.end()) {
-            return iter->first;
+        ObjString *interned = vm->strings.findString(chars, length, hash);
+        if (interned != nullptr) {
+            vm->internHits++;
+            return interned;
         }
+        vm->internMisses++;
 
-        std::string string = chars;
-        compute(0, string.capacity());
-        return allocateString(std::move(string));
+        auto *string = (ObjString *) allocateObject(stringSize(length), OBJ_STRING);
+        string->length = length;
+        string->hash = hash;
+        memcpy(string->chars, chars, length);
+        string->chars[length] = '\0';
+        internString(string);
+        return string;
     }
 
-    void markTable(Table *table) {
-        for (auto &item: *table) {
-            markObject(item.first);
-            markValue(item.second);
+    ObjString *concatStrings(ObjString *a, ObjString *b) {
+        // 哈希可以接着a的哈希继续算b 不用先拼出结果
+        uint32_t hash = hashString(b->chars, b->length, a->hash);
+        ObjString *interned = vm->strings.findString(a->chars, a->length, b->chars, b->length, hash);
+        if (interned != nullptr) {
+            vm->internHits++;
+            return interned;
         }
+        vm->internMisses++;
+
+        // 分配可能触发gc 调用者需保证a和b可达
+        int length = a->length + b->length;
+        auto *string = (ObjString *) allocateObject(stringSize(length), OBJ_STRING);
+        string->length = length;
+        string->hash = hash;
+        memcpy(string->chars, a->chars, a->length);
+        memcpy(string->chars + a->length, b->chars, b->length);
+        string->chars[length] = '\0';
+        internString(string);
+        return string;
     }
 
-    void tableRemoveWhite(Table *table) {
-        std::vector<ObjString *> toRemove;
-        for (const auto &item: *table) {
-            if (!item.first->isMarked) {
-                toRemove.push_back(item.first);
-            }
+    // 新建缓冲区 并写入a和b
+    static StringBuffer *newStringBuffer(Obj *a, Obj *b) {
+        int length = stringLength(a) + stringLength(b);
+        int capacity = GROW_CAPACITY(length);
+        auto *buffer = (StringBuffer *) reallocate<uint8_t>(nullptr, 0, sizeof(StringBuffer) + capacity);
+        buffer->refCount = 0;
+        buffer->length = length;
+        buffer->capacity = capacity;
+        memcpy(buffer->chars, stringChars(a), stringLength(a));
+        memcpy(buffer->chars + stringLength(a), stringChars(b), stringLength(b));
+        return buffer;
+    }
+
+    Obj *appendString(Obj *a, Obj *b) {
+        int length = stringLength(a) + stringLength(b);
+        if (length < BUILDER_MIN_LENGTH && a->type == OBJ_STRING && b->type == OBJ_STRING) {
+            return concatStrings((ObjString *) a, (ObjString *) b);
         }
 
-        for (const auto &item: toRemove) {
-            table->erase(item);
+        // 缓冲区不是gc对象 先准备好缓冲区再分配对象 分配可能触发gc 调用者需保证a和b可达
+        StringBuffer *buffer = a->type == OBJ_BUILDER ? ((ObjBuilder *) a)->buffer : nullptr;
+        if (buffer == nullptr || buffer->length != stringLength(a) || length > buffer->capacity) {
+            // 缓冲区已被别的视图追加过或者容量不够 复制到新缓冲区
+            buffer = newStringBuffer(a, b);
+        } else {
+            // a是缓冲区最新的内容 直接追加 a看到的前缀不变
+            memcpy(buffer->chars + buffer->length, stringChars(b), stringLength(b));
+            buffer->length = length;
         }
+        buffer->refCount++;
+
+        auto *builder = ALLOCATE_OBJ(ObjBuilder, OBJ_BUILDER);
+        builder->length = length;
+        builder->buffer = buffer;
+        return builder;
+    }
+
+    bool stringsEqual(Obj *a, Obj *b) {
+        if (a->type != OBJ_BUILDER && b->type != OBJ_BUILDER) return false;
+        if (a->type != OBJ_STRING && a->type != OBJ_BUILDER) return false;
+        if (b->type != OBJ_STRING && b->type != OBJ_BUILDER) return false;
+        return stringLength(a) == stringLength(b) &&
+               memcmp(stringChars(a), stringChars(b), stringLength(a)) == 0;
     }
 
     ObjUpvalue *newUpvalue(Value *slot) {
@@ -158,7 +336,7 @@ namespace cpplox {
             printf("<script>");
             return;
         }
-        printf("<fn %s>", function->name->chars->c_str());
+        printf("<fn %s>", function->name->chars);
     }
 
     void printObject(Value value) {
@@ -166,8 +344,11 @@ namespace cpplox {
             case OBJ_BOUND_METHOD:
                 printFunction(AS_BOUND_METHOD(value)->method->function);
                 break;
+            case OBJ_BUILDER:
+                printf("%.*s", AS_BUILDER(value)->length, AS_BUILDER(value)->buffer->chars);
+                break;
             case OBJ_CLASS:
-                printf("%s", AS_CLASS(value)->name->chars->c_str());
+                printf("%s", AS_CLASS(value)->name->chars);
                 break;
             case OBJ_CLOSURE:
                 printFunction(AS_CLOSURE(value)->function);
@@ -177,13 +358,13 @@ namespace cpplox {
                 break;
             case OBJ_INSTANCE:
                 printf("%s instance",
-                       AS_INSTANCE(value)->klass->name->chars->c_str());
+                       AS_INSTANCE(value)->klass->name->chars);
                 break;
             case OBJ_NATIVE:
                 printf("<native fn>");
                 break;
             case OBJ_STRING:
-                printf("%s", AS_CSTRING(value)->c_str());
+                printf("%s", AS_CSTRING(value));
                 break;
             case OBJ_UPVALUE:
                 printf("upvalue");
@@ -1 +1,276 @@
-//// Created by hlx on 2023/10/4.//#ifndef CPPLOX_OBJECT_H#define CPPLOX_OBJECT_H#include <string>#include <unordered_map>#include "common.h"#include "chunk.h"namespace cpplox {// 获取对象类型#define OBJ_TYPE(value)        (AS_OBJ(value)->type)// 是否是方法#define IS_BOUND_METHOD(value) isObjType(value, OBJ_BOUND_METHOD)// 是否为类#define IS_CLASS(value)        isObjType(value, OBJ_CLASS)// 是否为闭包#define IS_CLOSURE(value)      isObjType(value, OBJ_CLOSURE)// 是否为函数#define IS_FUNCTION(value)     isObjType(value, OBJ_FUNCTION)// 是否为实例#define IS_INSTANCE(value)     isObjType(value, OBJ_INSTANCE)// 是否为原生函数#define IS_NATIVE(value)       isObjType(value, OBJ_NATIVE)// 是否为字符串对象#define IS_STRING(value)       isObjType(value, OBJ_STRING)// 转化为方法对象#define AS_BOUND_METHOD(value) ((ObjBoundMethod*)AS_OBJ(value))// 转化为类对象#define AS_CLASS(value)        ((ObjClass*)AS_OBJ(value))// 函数值转化为闭包对象#define AS_CLOSURE(value)      ((ObjClosure*)AS_OBJ(value))// 函数值转化为函数对象#define AS_FUNCTION(value)     ((ObjFunction*)AS_OBJ(value))// 转化为的实例对象#define AS_INSTANCE(value)     ((ObjInstance*)AS_OBJ(value))// 转化为原生函数对象#define AS_NATIVE(value)       (((ObjNative*)AS_OBJ(value))->function)// c字符创转化成对象字符串#define AS_STRING(value)       ((ObjString*)AS_OBJ(value))// 对象字符创转化为c字符串#define AS_CSTRING(value)      (((ObjString*)AS_OBJ(value))->chars)// 对象类型枚举    enum ObjType {        OBJ_BOUND_METHOD,   // 绑定方法对象        OBJ_CLASS,          // 类对象        OBJ_CLOSURE,        // 闭包对象        OBJ_FUNCTION,       // 函数对象        OBJ_INSTANCE,       // 实例对象        OBJ_NATIVE,         // 原生函数对象        OBJ_STRING,         // 字符串对象        OBJ_UPVALUE,        // 闭包提升值对象    };    // 对象结构体    class Obj {    public:        ObjType type;       // 对象类型        bool isMarked;      // 是否被标记        struct Obj *next;   // 下一个对象    };    // 字符串对象结构体    class ObjString : public Obj {    public:        std::string *chars;    };    struct Equal {        bool operator()(const ObjString *x, ObjString *y) const {            return *x->chars == *y->chars;        }    };    struct Hash {        bool operator()(const ObjString *x) const {            uint32_t hash = 2166136261u;            for (char i: *x->chars) {                hash ^= (uint8_t) i;                hash *= 16777619;            }            return hash;        }    };    using Table = std::unordered_map<ObjString *, Value, Hash, Equal>;    void markTable(Table *table);    void tableRemoveWhite(Table *table);    // 函数对象结构体    class ObjFunction : public Obj {    public:        int arity;          // 参数数        int upvalueCount;   // 提升值数        Chunk *chunk;        // 函数的字节码块        ObjString *name;    // 函数名    };// 原生函数 函数指针    typedef Value (*NativeFn)(int argCount, Value *args);// 原生函数对象    class ObjNative : public Obj {    public:        NativeFn function;  // 原生函数指针    };// 提升值    class ObjUpvalue : public Obj {    public:        Value *location;            // 捕获的局部变量        Value closed;               //        struct ObjUpvalue *next;    // next指针    };// 闭包对象    class ObjClosure : public Obj {    public:        ObjFunction *function;      // 裸函数        ObjUpvalue **upvalues;      // 提升值数组        int upvalueCount;           // 提升值数量    };// 类对象    class ObjClass : public Obj {    public:        ObjString *name;        // 类名        Table *methods;          // 类方法    };// 实例对象    class ObjInstance : public Obj {    public:        ObjClass *klass;        Table *fields;    };// 绑定方法对象    class ObjBoundMethod : public Obj {    public:        Value receiver;        ObjClosure *method;    };// 新建方法    ObjBoundMethod *newBoundMethod(Value receiver, ObjClosure *method);// 新建类对象    ObjClass *newClass(ObjString *name);// 新建一个闭包对象    ObjClosure *newClosure(ObjFunction *function);// 新建一个函数对象    ObjFunction *newFunction();// 新建一个实例对象    ObjInstance *newInstance(ObjClass *klass);// 新建一个原生函数    ObjNative *newNative(NativeFn function);// 取c字符串成字符串类型    ObjString *takeString(std::string chars);// 在堆中复制字符创 并返回指针    ObjString *copyString(const std::string &chars);// 新建提升值    ObjUpvalue *newUpvalue(Value *slot);// 打印对象    void printObject(Value value);// 内联函数判断对象是否为指定类型    static inline bool isObjType(Value value, ObjType type) {        return IS_OBJ(value) && AS_OBJ(value)->type == type;    }}#endif //CPPLOX_OBJECT_H
\ No newline at end of file
+//
+// Created by hlx on 2023/10/4.
+//
+
+#ifndef CPPLOX_OBJECT_H
+#define CPPLOX_OBJECT_H
+
+#include <string>
+#include <vector>
+#include "common.h"
+#include "chunk.h"
+#include "table.h"
+
+namespace cpplox {
+
+    struct JitCode;
+
+    struct RegisterCode;
+
+// 获取对象类型
+#define OBJ_TYPE(value)        (AS_OBJ(value)->type)
+
+// 是否是方法
+#define IS_BOUND_METHOD(value) isObjType(value, OBJ_BOUND_METHOD)
+// 是否为拼接中的字符串
+#define IS_BUILDER(value)      isObjType(value, OBJ_BUILDER)
+// 是否为类
+#define IS_CLASS(value)        isObjType(value, OBJ_CLASS)
+// 是否为闭包
+#define IS_CLOSURE(value)      isObjType(value, OBJ_CLOSURE)
+// 是否为函数
+#define IS_FUNCTION(value)     isObjType(value, OBJ_FUNCTION)
+// 是否为实例
+#define IS_INSTANCE(value)     isObjType(value, OBJ_INSTANCE)
+// 是否为原生函数
+#define IS_NATIVE(value)       isObjType(value, OBJ_NATIVE)
+// 是否为字符串对象
+#define IS_STRING(value)       isObjType(value, OBJ_STRING)
+// 是否为字符串 驻留的或拼接中的
+#define IS_ANY_STRING(value)   (IS_STRING(value) || IS_BUILDER(value))
+
+// 转化为方法对象
+#define AS_BOUND_METHOD(value) ((ObjBoundMethod*)AS_OBJ(value))
+// 转化为拼接中的字符串对象
+#define AS_BUILDER(value)      ((ObjBuilder*)AS_OBJ(value))
+// 转化为类对象
+#define AS_CLASS(value)        ((ObjClass*)AS_OBJ(value))
+// 函数值转化为闭包对象
+#define AS_CLOSURE(value)      ((ObjClosure*)AS_OBJ(value))
+// 函数值转化为函数对象
+#define AS_FUNCTION(value)     ((ObjFunction*)AS_OBJ(value))
+// 转化为的实例对象
+#define AS_INSTANCE(value)     ((ObjInstance*)AS_OBJ(value))
+// 转化为原生函数对象
+#define AS_NATIVE(value)       (((ObjNative*)AS_OBJ(value))->function)
+// c字符创转化成对象字符串
+#define AS_STRING(value)       ((ObjString*)AS_OBJ(value))
+// 对象字符创转化为c字符串
+#define AS_CSTRING(value)      (((ObjString*)AS_OBJ(value))->chars)
+
+// 对象类型枚举
+    enum ObjType {
+        OBJ_BOUND_METHOD,   // 绑定方法对象
+        OBJ_BUILDER,        // 拼接中的字符串对象
+        OBJ_CLASS,          // 类对象
+        OBJ_CLOSURE,        // 闭包对象
+        OBJ_FUNCTION,       // 函数对象
+        OBJ_INSTANCE,       // 实例对象
+        OBJ_NATIVE,         // 原生函数对象
+        OBJ_STRING,         // 字符串对象
+        OBJ_UPVALUE,        // 闭包提升值对象
+    };
+
+    // 对象结构体
+    class Obj {
+    public:
+        ObjType type;       // 对象类型
+        bool isMarked;      // 是否被标记 新生代回收时表示已晋升 next为晋升后的地址
+        bool isRemembered;  // 是否在记忆集中
+        struct Obj *next;   // 下一个对象
+    };
+
+    // 字符串对象结构体
+    class ObjString : public Obj {
+    public:
+        int length;         // 字符数 不含结尾的'\0'
+        uint32_t hash;      // 驻留时计算一次的哈希
+        char chars[];       // 以'\0'结尾的字符 与对象头一次分配
+    };
+
+    // 拼接结果达到该长度后不再驻留 改为追加到共享缓冲区
+    const int BUILDER_MIN_LENGTH = 64;
+
+    // 字符串缓冲区 不是gc对象 由引用它的ObjBuilder计数
+    struct StringBuffer {
+        int refCount;       // 引用该缓冲区的ObjBuilder数
+        int length;         // 已写入的字符数
+        int capacity;       // 字符容量
+        char chars[];       // 字符 不以'\0'结尾
+    };
+
+    // 拼接中的字符串 是缓冲区前length个字符的视图
+    // 视图是缓冲区最新的内容时 再拼接可以直接追加 循环拼接因此是线性的
+    // 不驻留 比较时按内容比较
+    class ObjBuilder : public Obj {
+    public:
+        int length;             // 字符数
+        StringBuffer *buffer;   // 共享的缓冲区 只会追加 不会修改已写入的字符
+    };
+
+    // 函数对象结构体
+    class ObjFunction : public Obj {
+    public:
+        int arity;          // 参数数
+        int upvalueCount;   // 提升值数
+        Chunk *chunk;        // 函数的字节码块
+        ObjString *name;    // 函数名
+        uint32_t hotness;   // 调用和循环回跳次数 达到阈值时编译
+        JitCode *jit;       // 编译出的机器码 未编译为nullptr
+        RegisterCode *registers; // 翻译出的寄存器代码 未翻译为nullptr
+    };
+
+// 原生函数 函数指针
+    typedef Value (*NativeFn)(int argCount, Value *args);
+
+// 原生函数对象
+    class ObjNative : public Obj {
+    public:
+        NativeFn function;  // 原生函数指针
+    };
+
+
+// 提升值
+    class ObjUpvalue : public Obj {
+    public:
+        Value *location;            // 捕获的局部变量
+        Value closed;               //
+        struct ObjUpvalue *next;    // next指针
+    };
+
+// 闭包对象
+    class ObjClosure : public Obj {
+    public:
+        ObjFunction *function;      // 裸函数
+        ObjUpvalue **upvalues;      // 提升值数组
+        int upvalueCount;           // 提升值数量
+    };
+
+// 类对象
+    class ObjClass : public Obj {
+    public:
+        ObjString *name;        // 类名
+        Table *methods;          // 类方法
+        int version;            // 方法表版本 方法表变化时递增 使内联缓存失效
+        int slotHint;           // 该类实例出现过的最多字段数 新实例按此预留内联槽位
+    };
+
+// 形状最多描述的字段数 超过后实例转为字典模式
+    const int SHAPE_MAX_SLOTS = 32;
+
+// 形状(隐藏类) 按添加顺序描述实例字段名到槽位的映射
+// 以相同顺序添加相同字段的实例共享同一个形状 形状之间构成转移树
+    class Shape {
+    public:
+        Shape *parent;          // 父形状 根形状为nullptr
+        ObjString *key;         // 相对父形状新增的字段名
+        int slotCount;          // 字段数量 新增字段的槽位为slotCount - 1
+        std::vector<std::pair<ObjString *, Shape *>> transitions; // 添加字段后的子形状
+
+        Shape(Shape *parent, ObjString *key);
+
+        // 查找字段槽位 不存在返回-1
+        int lookup(ObjString *name);
+
+        // 添加字段后的形状 不存在时新建
+        Shape *transition(ObjString *name);
+
+        ~Shape();
+    };
+
+// 实例对象
+    class ObjInstance : public Obj {
+    public:
+        ObjClass *klass;
+        Shape *shape;           // 形状 字典模式下为nullptr
+        Table *fields;          // 字典模式下的字段表 否则为nullptr
+        Value *overflow;        // 字段超出内联槽位后迁移到的数组
+        int capacity;           // 内联槽位数量
+        int overflowCapacity;   // 溢出数组容量
+        Value inlineSlots[];    // 内联字段槽位 由形状索引
+
+        // 当前存放字段的槽位数组
+        Value *slots() {
+            return overflow != nullptr ? overflow : inlineSlots;
+        }
+    };
+
+// 绑定方法对象
+    class ObjBoundMethod : public Obj {
+    public:
+        Value receiver;
+        ObjClosure *method;
+    };
+
+// 新建方法
+    ObjBoundMethod *newBoundMethod(Value receiver, ObjClosure *method);
+
+// 新建类对象
+    ObjClass *newClass(ObjString *name);
+
+// 新建一个闭包对象
+    ObjClosure *newClosure(ObjFunction *function);
+
+// 新建一个函数对象
+    ObjFunction *newFunction();
+
+// 新建一个实例对象
+    ObjInstance *newInstance(ObjClass *klass);
+
+// 读取实例字段 不存在返回false
+    bool instanceGet(ObjInstance *instance, ObjString *name, Value *value);
+
+// 写入实例字段 新字段会转移形状 字段过多时转为字典模式
+    void instanceSet(ObjInstance *instance, ObjString *name, Value value);
+
+// 保证实例能容纳count个字段 可能触发gc
+    void instanceReserve(ObjInstance *instance, int count);
+
+// 实例对象占用的字节数
+    size_t instanceSize(ObjInstance *instance);
+
+// 字符串对象占用的字节数
+    size_t stringSize(int length);
+
+// 新建一个原生函数
+    ObjNative *newNative(NativeFn function);
+
+// 拼接两个字符串对象(ObjString或ObjBuilder) 长结果返回ObjBuilder
+    Obj *appendString(Obj *a, Obj *b);
+
+// 至少有一个是ObjBuilder时按内容比较两个字符串对象 其它情况返回false
+    bool stringsEqual(Obj *a, Obj *b);
+
+// 在堆中复制字符创 并返回指针 已驻留时不分配
+    ObjString *copyString(const char *chars, int length);
+
+// 拼接两个字符串 结果已驻留时不分配
+    ObjString *concatStrings(ObjString *a, ObjString *b);
+
+// 新建提升值
+    ObjUpvalue *newUpvalue(Value *slot);
+
+// 打印对象
+    void printObject(Value value);
+
+// 内联函数判断对象是否为指定类型
+    static inline bool isObjType(Value value, ObjType type) {
+        return IS_OBJ(value) && AS_OBJ(value)->type == type;
+    }
+
+// 字符串对象的字符 ObjBuilder的字符不以'\0'结尾
+    static inline const char *stringChars(Obj *string) {
+        if (string->type == OBJ_BUILDER) return ((ObjBuilder *) string)->buffer->chars;
+        return ((ObjString *) string)->chars;
+    }
+
+// 字符串对象的字符数
+    static inline int stringLength(Obj *string) {
+        if (string->type == OBJ_BUILDER) return ((ObjBuilder *) string)->length;
+        return ((ObjString *) string)->length;
+    }
+
+
+}
+
+#endif //CPPLOX_OBJECT_H
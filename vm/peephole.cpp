@@ -0,0 +1,242 @@
+//
+// Created by hlx on 2023/10/4.
+//
+
+#include <vector>
+
+#include "peephole.h"
+#include "value.h"
+
+namespace cpplox {
+
+    // 解码后的一条指令
+    struct Instruction {
+        uint8_t opcode;
+        std::vector<uint8_t> operands;  // 跳转指令的偏移在写回时按新位置重新计算
+        int line;                       // 合并的指令取第一条的行号
+        int target;                     // 跳转目标的指令下标 等于指令数时为末尾 不是跳转时为-1
+        bool removed;                   // 已被合并或删除 跳到这里的改为跳到后面第一条保留的指令
+    };
+
+    static bool isJump(uint8_t opcode) {
+        switch (opcode) {
+            case OP_JUMP:
+            case OP_JUMP_IF_FALSE:
+            case OP_LOOP:
+            case OP_POP_JUMP_IF_FALSE:
+            case OP_EQUAL_JUMP_IF_FALSE:
+            case OP_GREATER_JUMP_IF_FALSE:
+            case OP_LESS_JUMP_IF_FALSE:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    static std::vector<Instruction> decode(Chunk *chunk) {
+        int count = (int) chunk->code.size();
+        std::vector<int> indices(count + 1, -1);
+        std::vector<int> offsets;
+        std::vector<Instruction> instructions;
+        for (int offset = 0; offset < count; offset += chunk->instructionLength(offset)) {
+            uint8_t *ip = &chunk->code[offset];
+            indices[offset] = (int) instructions.size();
+            offsets.push_back(offset);
+            instructions.push_back(Instruction{ip[0], std::vector<uint8_t>(ip + 1, ip + chunk->instructionLength(offset)),
+                                               chunk->lines[offset], -1, false});
+        }
+        indices[count] = (int) instructions.size();
+
+        for (size_t i = 0; i < instructions.size(); i++) {
+            Instruction &instruction = instructions[i];
+            if (!isJump(instruction.opcode)) continue;
+            int jump = (instruction.operands[0] << 8) | instruction.operands[1];
+            int end = offsets[i] + 3;
+            instruction.target = indices[instruction.opcode == OP_LOOP ? end - jump : end + jump];
+        }
+        return instructions;
+    }
+
+    // 按新位置写回字节码 删除的指令不占位置 它的位置就是后面第一条保留的指令
+    static void encode(Chunk *chunk, std::vector<Instruction> &instructions) {
+        int count = (int) instructions.size();
+        std::vector<int> offsets(count + 1);
+        int offset = 0;
+        for (int i = 0; i < count; i++) {
+            offsets[i] = offset;
+            if (!instructions[i].removed) offset += 1 + (int) instructions[i].operands.size();
+        }
+        offsets[count] = offset;
+
+        std::vector<uint8_t> code;
+        std::vector<int> lines;
+        for (int i = 0; i < count; i++) {
+            Instruction &instruction = instructions[i];
+            if (instruction.removed) continue;
+            if (isJump(instruction.opcode)) {
+                // 指令只会变少 偏移不会超出原来的范围
+                int end = offsets[i] + 3;
+                int jump = instruction.opcode == OP_LOOP ? end - offsets[instruction.target]
+                                                         : offsets[instruction.target] - end;
+                instruction.operands[0] = (jump >> 8) & 0xff;
+                instruction.operands[1] = jump & 0xff;
+            }
+            code.push_back(instruction.opcode);
+            code.insert(code.end(), instruction.operands.begin(), instruction.operands.end());
+            lines.insert(lines.end(), 1 + instruction.operands.size(), instruction.line);
+        }
+        chunk->assign(code.data(), lines.data(), code.size(), (int) chunk->caches.size());
+    }
+
+    // 下一条保留的指令
+    static int next(std::vector<Instruction> &instructions, int index) {
+        int count = (int) instructions.size();
+        do {
+            index++;
+        } while (index < count && instructions[index].removed);
+        return index;
+    }
+
+    // 各指令被跳转到的次数 被跳转到的指令不能并入前一条
+    static std::vector<int> countIncoming(std::vector<Instruction> &instructions) {
+        std::vector<int> incoming(instructions.size() + 1, 0);
+        for (Instruction &instruction: instructions) {
+            if (!instruction.removed && isJump(instruction.opcode)) incoming[instruction.target]++;
+        }
+        return incoming;
+    }
+
+    static bool hasOpcode(std::vector<Instruction> &instructions, int index, uint8_t opcode) {
+        return index < (int) instructions.size() && instructions[index].opcode == opcode;
+    }
+
+    // OP_JUMP_IF_FALSE; OP_POP 且跳转目标也是OP_POP时 两条路径都弹出条件
+    // 合并为OP_POP_JUMP_IF_FALSE 跳转目标改为目标的OP_POP之后 if while for的条件都是这种形式
+    static void fuseConditionalJumps(std::vector<Instruction> &instructions) {
+        std::vector<int> incoming = countIncoming(instructions);
+        for (int i = 0; i < (int) instructions.size(); i++) {
+            Instruction &jump = instructions[i];
+            if (jump.removed || jump.opcode != OP_JUMP_IF_FALSE) continue;
+            int pop = next(instructions, i);
+            if (!hasOpcode(instructions, pop, OP_POP) || incoming[pop] > 0) continue;
+            if (!hasOpcode(instructions, jump.target, OP_POP) || instructions[jump.target].removed) continue;
+
+            incoming[jump.target]--;
+            jump.target = next(instructions, jump.target);
+            incoming[jump.target]++;
+            jump.opcode = OP_POP_JUMP_IF_FALSE;
+            instructions[pop].removed = true;
+        }
+    }
+
+    // 比较后紧跟OP_POP_JUMP_IF_FALSE时合并 循环条件多为这种形式
+    static void fuseComparisons(std::vector<Instruction> &instructions) {
+        std::vector<int> incoming = countIncoming(instructions);
+        for (int i = 0; i < (int) instructions.size(); i++) {
+            Instruction &compare = instructions[i];
+            if (compare.removed) continue;
+            uint8_t fused;
+            switch (compare.opcode) {
+                case OP_EQUAL:
+                    fused = OP_EQUAL_JUMP_IF_FALSE;
+                    break;
+                case OP_GREATER:
+                    fused = OP_GREATER_JUMP_IF_FALSE;
+                    break;
+                case OP_LESS:
+                    fused = OP_LESS_JUMP_IF_FALSE;
+                    break;
+                default:
+                    continue;
+            }
+            int jump = next(instructions, i);
+            if (!hasOpcode(instructions, jump, OP_POP_JUMP_IF_FALSE) || incoming[jump] > 0) continue;
+
+            compare.opcode = fused;
+            compare.operands = instructions[jump].operands;
+            compare.target = instructions[jump].target;
+            instructions[jump].removed = true;
+        }
+    }
+
+    // OP_GET_LOCAL; OP_GET_PROPERTY 合并 方法中读取this的字段都是这种形式
+    static void fuseLocalProperties(std::vector<Instruction> &instructions) {
+        std::vector<int> incoming = countIncoming(instructions);
+        for (int i = 0; i < (int) instructions.size(); i++) {
+            Instruction &local = instructions[i];
+            if (local.removed || local.opcode != OP_GET_LOCAL) continue;
+            int property = next(instructions, i);
+            if (!hasOpcode(instructions, property, OP_GET_PROPERTY) || incoming[property] > 0) continue;
+
+            local.opcode = OP_GET_LOCAL_PROPERTY;
+            local.operands.insert(local.operands.end(), instructions[property].operands.begin(),
+                                  instructions[property].operands.end());
+            instructions[property].removed = true;
+        }
+    }
+
+    // a = a + 数字常量; 即 OP_GET_LOCAL a; OP_CONSTANT; OP_ADD; OP_SET_LOCAL a; OP_POP 合并为一条 for的增量子句多为这种形式
+    // 常量是数字时只有a也是数字才不报错 合并后的指令报同样的错误
+    static void fuseLocalIncrements(Chunk *chunk, std::vector<Instruction> &instructions) {
+        std::vector<int> incoming = countIncoming(instructions);
+        for (int i = 0; i < (int) instructions.size(); i++) {
+            Instruction &get = instructions[i];
+            if (get.removed || get.opcode != OP_GET_LOCAL) continue;
+            int sequence[4];
+            int index = i;
+            bool fusable = true;
+            for (int &step: sequence) {
+                step = index = next(instructions, index);
+                if (index >= (int) instructions.size() || incoming[index] > 0) fusable = false;
+                if (!fusable) break;
+            }
+            if (!fusable) continue;
+            Instruction &constant = instructions[sequence[0]];
+            Instruction &set = instructions[sequence[2]];
+            if (constant.opcode != OP_CONSTANT || instructions[sequence[1]].opcode != OP_ADD ||
+                set.opcode != OP_SET_LOCAL || instructions[sequence[3]].opcode != OP_POP) {
+                continue;
+            }
+            if (set.operands[0] != get.operands[0] || !IS_NUMBER(chunk->constants[constant.operands[0]])) continue;
+
+            get.opcode = OP_ADD_LOCAL_CONSTANT;
+            get.operands.push_back(constant.operands[0]);
+            for (int step: sequence) instructions[step].removed = true;
+        }
+    }
+
+    // 删除执行不到的指令 无条件转移之后没有跳转进来的OP_POP 以及跳到下一条的OP_JUMP
+    // 合并条件跳转后 if和循环出口处原来弹出条件的OP_POP都执行不到了
+    static void removeDeadCode(std::vector<Instruction> &instructions) {
+        std::vector<int> incoming = countIncoming(instructions);
+        for (int i = 0; i < (int) instructions.size(); i++) {
+            Instruction &instruction = instructions[i];
+            if (instruction.removed) continue;
+            if (instruction.opcode != OP_JUMP && instruction.opcode != OP_LOOP && instruction.opcode != OP_RETURN) {
+                continue;
+            }
+            int pop = next(instructions, i);
+            if (hasOpcode(instructions, pop, OP_POP) && incoming[pop] == 0) instructions[pop].removed = true;
+        }
+
+        for (int i = 0; i < (int) instructions.size(); i++) {
+            Instruction &jump = instructions[i];
+            if (jump.removed || jump.opcode != OP_JUMP) continue;
+            // 目标被删除时实际跳到它后面第一条保留的指令
+            int target = jump.target;
+            if (target < (int) instructions.size() && instructions[target].removed) target = next(instructions, target);
+            if (target == next(instructions, i)) jump.removed = true;
+        }
+    }
+
+    void optimizeChunk(Chunk *chunk) {
+        std::vector<Instruction> instructions = decode(chunk);
+        fuseConditionalJumps(instructions);
+        fuseComparisons(instructions);
+        fuseLocalProperties(instructions);
+        fuseLocalIncrements(chunk, instructions);
+        removeDeadCode(instructions);
+        encode(chunk, instructions);
+    }
+
+}
@@ -0,0 +1,18 @@
+//
+// Created by hlx on 2023/10/4.
+//
+
+#ifndef CPPLOX_PEEPHOLE_H
+#define CPPLOX_PEEPHOLE_H
+
+#include "chunk.h"
+
+namespace cpplox {
+
+    // 编译结束后的窥孔优化 把常见的相邻指令合并成超级指令 删除执行不到的OP_POP和跳到下一条的OP_JUMP
+    // 合并哪些序列按各基准程序统计的相邻操作码频率选取 跳转偏移和行号按新位置重写
+    void optimizeChunk(Chunk *chunk);
+
+}
+
+#endif //CPPLOX_PEEPHOLE_H
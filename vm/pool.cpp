@@ -0,0 +1,68 @@
+//
+// Created by hlx on 2023/10/4.
+//
+
+#include <cstring>
+
+#include "pool.h"
+
+namespace cpplox {
+
+    Pool::Pool() {
+        for (int i = 0; i < POOL_CLASS_COUNT; i++) {
+            this->freeLists[i] = nullptr;
+            this->bumpTop[i] = nullptr;
+            this->bumpEnd[i] = nullptr;
+        }
+        this->chunks = nullptr;
+    }
+
+    Pool::~Pool() {
+        clear();
+    }
+
+    void *Pool::refill(int index) {
+        size_t blockSize = (index + 1) * POOL_GRANULE;
+        if (this->bumpTop[index] == nullptr || (size_t) (this->bumpEnd[index] - this->bumpTop[index]) < blockSize) {
+            auto *chunk = (uint8_t *) aligned_alloc(POOL_PAGE_SIZE, POOL_CHUNK_SIZE);
+            if (chunk == nullptr) return nullptr;
+            // 大块开头串起所有大块 之后的空间按块大小切分
+            *(uint8_t **) chunk = this->chunks;
+            this->chunks = chunk;
+            this->bumpTop[index] = chunk + POOL_GRANULE;
+            this->bumpEnd[index] = chunk + POOL_CHUNK_SIZE;
+        }
+        void *block = this->bumpTop[index];
+        this->bumpTop[index] += blockSize;
+        return block;
+    }
+
+    void *Pool::reallocate(void *pointer, size_t oldSize, size_t newSize) {
+        if (pointer == nullptr) return allocate(newSize);
+        if (oldSize > POOL_MAX_SIZE && newSize > POOL_MAX_SIZE) return realloc(pointer, newSize);
+        // 同一尺寸类别内不用移动
+        if (oldSize <= POOL_MAX_SIZE && newSize <= POOL_MAX_SIZE && sizeClass(oldSize) == sizeClass(newSize)) {
+            return pointer;
+        }
+
+        void *result = allocate(newSize);
+        if (result == nullptr) return nullptr;
+        memcpy(result, pointer, oldSize < newSize ? oldSize : newSize);
+        free(pointer, oldSize);
+        return result;
+    }
+
+    void Pool::clear() {
+        while (this->chunks != nullptr) {
+            uint8_t *previous = *(uint8_t **) this->chunks;
+            ::free(this->chunks);
+            this->chunks = previous;
+        }
+        for (int i = 0; i < POOL_CLASS_COUNT; i++) {
+            this->freeLists[i] = nullptr;
+            this->bumpTop[i] = nullptr;
+            this->bumpEnd[i] = nullptr;
+        }
+    }
+
+}
@@ -0,0 +1,87 @@
+//
+// Created by hlx on 2023/10/4.
+//
+
+#ifndef CPPLOX_POOL_H
+#define CPPLOX_POOL_H
+
+#include <cstdlib>
+#include "common.h"
+
+namespace cpplox {
+
+    // 尺寸类别的粒度 第i个类别的块大小为(i + 1) * POOL_GRANULE
+    const size_t POOL_GRANULE = 16;
+    // 由内存池分配的最大块 更大的交给malloc
+    const size_t POOL_MAX_SIZE = 256;
+    // 尺寸类别数量
+    const int POOL_CLASS_COUNT = POOL_MAX_SIZE / POOL_GRANULE;
+    // 内存池每次向系统申请的大块 按页对齐 只切给一个尺寸类别
+    const size_t POOL_CHUNK_SIZE = 64 * 1024;
+    const size_t POOL_PAGE_SIZE = 4096;
+
+    // 空闲块 空闲时块的开头存放下一个空闲块
+    struct PoolBlock {
+        PoolBlock *next;
+    };
+
+    // 按尺寸类别分组的小块内存池 每个类别一条空闲链表
+    // 释放时由调用者给出原大小 块本身不记录大小
+    class Pool {
+    public:
+        PoolBlock *freeLists[POOL_CLASS_COUNT];  // 各类别的空闲链表
+        uint8_t *bumpTop[POOL_CLASS_COUNT];      // 各类别当前大块中未切分部分的起点
+        uint8_t *bumpEnd[POOL_CLASS_COUNT];      // 各类别当前大块的末尾
+        uint8_t *chunks;                         // 申请过的大块 开头存放上一个大块
+
+        Pool();
+
+        Pool(const Pool &) = delete;
+
+        Pool &operator=(const Pool &) = delete;
+
+        // 分配size字节 size不为0
+        void *allocate(size_t size) {
+            if (size > POOL_MAX_SIZE) return malloc(size);
+            int index = sizeClass(size);
+            PoolBlock *block = freeLists[index];
+            if (block != nullptr) {
+                freeLists[index] = block->next;
+                return block;
+            }
+            return refill(index);
+        }
+
+        // 归还allocate(size)得到的内存
+        void free(void *pointer, size_t size) {
+            if (pointer == nullptr) return;
+            if (size > POOL_MAX_SIZE) {
+                ::free(pointer);
+                return;
+            }
+            int index = sizeClass(size);
+            auto *block = (PoolBlock *) pointer;
+            block->next = freeLists[index];
+            freeLists[index] = block;
+        }
+
+        // 改变大小 保留前min(oldSize, newSize)字节 newSize不为0
+        void *reallocate(void *pointer, size_t oldSize, size_t newSize);
+
+        // 把所有大块还给系统 之后池中分配的内存都失效
+        void clear();
+
+        ~Pool();
+
+    private:
+        static int sizeClass(size_t size) {
+            return (int) ((size - 1) / POOL_GRANULE);
+        }
+
+        // 当前大块用完时申请新的大块 返回切出的第一块
+        void *refill(int index);
+    };
+
+}
+
+#endif //CPPLOX_POOL_H
@@ -0,0 +1,141 @@
+//
+// Created by hlx on 2023/10/4.
+//
+
+#include <algorithm>
+#include <csignal>
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "profiler.h"
+#include "vm.h"
+
+namespace cpplox {
+
+    // 只打标记 采样在虚拟机的安全点进行
+    static void onProfileSignal(int) {
+        if (vm != nullptr) vm->profileTick = 1;
+    }
+
+    Profiler::Profiler(long interval) : interval(interval), timer(), running(false), sampleCount(0) {}
+
+    Profiler::~Profiler() {
+        stop();
+    }
+
+    bool Profiler::start(VM *machine) {
+        struct sigaction action{};
+        action.sa_handler = onProfileSignal;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        if (sigaction(SIGPROF, &action, nullptr) != 0) return false;
+
+        // 定时器按本线程的CPU时间计时 信号也只发给本线程 每个线程的虚拟机各自采样
+        struct sigevent event{};
+        event.sigev_notify = SIGEV_THREAD_ID;
+        event.sigev_signo = SIGPROF;
+        event._sigev_un._tid = (pid_t) syscall(SYS_gettid);
+        if (timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &this->timer) != 0) return false;
+
+        struct itimerspec spec{};
+        spec.it_interval.tv_sec = this->interval / 1000000;
+        spec.it_interval.tv_nsec = (this->interval % 1000000) * 1000;
+        spec.it_value = spec.it_interval;
+        if (timer_settime(this->timer, 0, &spec, nullptr) != 0) {
+            timer_delete(this->timer);
+            return false;
+        }
+        machine->profiler = this;
+        machine->profileTick = 0;
+        this->running = true;
+        return true;
+    }
+
+    void Profiler::stop() {
+        if (!this->running) return;
+        timer_delete(this->timer);
+        this->running = false;
+    }
+
+    int Profiler::functionId(ObjFunction *function) {
+        // 同名函数按定义所在行区分
+        std::string name = function->name != nullptr ? function->name->chars : "script";
+        if (!function->chunk->lines.empty()) name += ":" + std::to_string(function->chunk->lines[0]);
+
+        auto found = this->functionIds.find(name);
+        if (found != this->functionIds.end()) return found->second;
+        int id = (int) this->functions.size();
+        this->functions.push_back(FunctionStats{name, 0, 0, 0});
+        this->functionIds.emplace(name, id);
+        return id;
+    }
+
+    void Profiler::sample(VM *machine) {
+        machine->profileTick = 0;
+        if (machine->frameCount == 0) return;
+        this->sampleCount++;
+
+        int first = machine->frameCount > PROFILE_MAX_DEPTH ? machine->frameCount - PROFILE_MAX_DEPTH : 0;
+        std::string stack = first > 0 ? "..." : "";
+        int id = 0;
+        for (int i = first; i < machine->frameCount; i++) {
+            id = functionId(machine->frames[i].closure->function);
+            FunctionStats &stats = this->functions[id];
+            if (stats.lastSample != this->sampleCount) {
+                stats.lastSample = this->sampleCount;
+                stats.total++;
+            }
+            if (!stack.empty()) stack += ";";
+            stack += stats.name;
+        }
+
+        // ip指向下一条指令 当前指令是它的前一个字节所在的指令
+        CallFrame *frame = &machine->frames[machine->frameCount - 1];
+        Chunk *chunk = frame->closure->function->chunk;
+        size_t instruction = frame->ip - chunk->code.data() - 1;
+        int line = instruction < chunk->lines.size() ? chunk->lines[instruction] : 0;
+
+        this->functions[id].self++;
+        this->lines[std::make_pair(id, line)]++;
+        this->stacks[stack]++;
+    }
+
+    void Profiler::writeReport(FILE *file) {
+        double scale = this->sampleCount > 0 ? 100.0 / (double) this->sampleCount : 0;
+        fprintf(file, "%zu samples, %ld us interval\n\n", this->sampleCount, this->interval);
+
+        std::vector<int> order(this->functions.size());
+        for (size_t i = 0; i < order.size(); i++) order[i] = (int) i;
+        std::sort(order.begin(), order.end(), [this](int a, int b) {
+            if (this->functions[a].self != this->functions[b].self) {
+                return this->functions[a].self > this->functions[b].self;
+            }
+            return this->functions[a].total > this->functions[b].total;
+        });
+        fprintf(file, "%8s %8s %8s %8s  %s\n", "self%", "total%", "self", "total", "function");
+        for (int id: order) {
+            FunctionStats &stats = this->functions[id];
+            fprintf(file, "%7.2f%% %7.2f%% %8zu %8zu  %s\n", stats.self * scale, stats.total * scale,
+                    stats.self, stats.total, stats.name.c_str());
+        }
+
+        std::vector<std::pair<std::pair<int, int>, size_t>> ranked(this->lines.begin(), this->lines.end());
+        std::stable_sort(ranked.begin(), ranked.end(), [](const std::pair<std::pair<int, int>, size_t> &a,
+                                                         const std::pair<std::pair<int, int>, size_t> &b) {
+            return a.second > b.second;
+        });
+        fprintf(file, "\n%8s %8s  %s\n", "self%", "self", "line");
+        for (auto &entry: ranked) {
+            fprintf(file, "%7.2f%% %8zu  %s line %d\n", entry.second * scale, entry.second,
+                    this->functions[entry.first.first].name.c_str(), entry.first.second);
+        }
+    }
+
+    void Profiler::writeFolded(FILE *file) {
+        std::vector<std::pair<std::string, size_t>> sorted(this->stacks.begin(), this->stacks.end());
+        std::sort(sorted.begin(), sorted.end());
+        for (auto &entry: sorted) fprintf(file, "%s %zu\n", entry.first.c_str(), entry.second);
+    }
+
+}
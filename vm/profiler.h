@@ -0,0 +1,76 @@
+//
+// Created by hlx on 2023/10/4.
+//
+
+#ifndef CPPLOX_PROFILER_H
+#define CPPLOX_PROFILER_H
+
+#include <cstdio>
+#include <ctime>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "common.h"
+#include "object.h"
+
+namespace cpplox {
+
+    class VM;
+
+    // 默认采样间隔 线程CPU时间 微秒
+    const long PROFILE_INTERVAL = 1000;
+    // 每个样本最多记录的栈帧数 更深的调用栈只记录最内层
+    const int PROFILE_MAX_DEPTH = 64;
+
+    // 采样分析器 定时器信号只给虚拟机打标记 虚拟机在下一个安全点调用sample记录调用栈
+    // 信号处理函数里不碰堆 新生代回收移动对象也不影响采样
+    class Profiler {
+    public:
+        explicit Profiler(long interval);
+
+        Profiler(const Profiler &) = delete;
+
+        Profiler &operator=(const Profiler &) = delete;
+
+        // 为当前线程创建CPU时间定时器 到期时给当前线程的虚拟机打标记
+        bool start(VM *vm);
+
+        void stop();
+
+        // 记录虚拟机当前的调用栈 栈顶的函数和行计自身时间 栈上每个函数计一次总时间
+        void sample(VM *vm);
+
+        // 按自身时间排序的函数表和行表
+        void writeReport(FILE *file);
+
+        // 折叠的调用栈 每行为"外层;内层 样本数" 可直接交给火焰图工具
+        void writeFolded(FILE *file);
+
+        ~Profiler();
+
+    private:
+        // 一个函数的样本数
+        struct FunctionStats {
+            std::string name;       // 函数名和定义所在行
+            size_t self;            // 位于栈顶的样本数
+            size_t total;           // 位于栈上的样本数
+            size_t lastSample;      // 最近计入总时间的样本 递归时只计一次
+        };
+
+        long interval;
+        timer_t timer;
+        bool running;
+        size_t sampleCount;
+        std::vector<FunctionStats> functions;
+        std::unordered_map<std::string, int> functionIds;
+        std::map<std::pair<int, int>, size_t> lines;        // (函数, 行)的自身样本数
+        std::unordered_map<std::string, size_t> stacks;     // 折叠的调用栈的样本数
+
+        int functionId(ObjFunction *function);
+    };
+
+}
+
+#endif //CPPLOX_PROFILER_H
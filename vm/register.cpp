@@ -0,0 +1,670 @@
+//
+// Created by hlx on 2023/10/4.
+//
+
+#include "register.h"
+#include "memory.h"
+#include "profiler.h"
+#include "vm.h"
+
+#ifdef DEBUG_PRINT_CODE
+
+#include "debug.h"
+
+#endif
+
+namespace cpplox {
+
+    // 寄存器操作数 非负为槽位下标 为负为常量下标
+    typedef int32_t Operand;
+
+    static inline Operand constantOperand(int index) {
+        return -1 - index;
+    }
+
+    // 指令执行后栈深的变化
+    static int stackEffect(const uint8_t *ip) {
+        switch (ip[0]) {
+            case OP_CONSTANT:
+            case OP_NIL:
+            case OP_TRUE:
+            case OP_FALSE:
+            case OP_GET_LOCAL:
+            case OP_GET_GLOBAL:
+            case OP_GET_UPVALUE:
+            case OP_CLOSURE:
+            case OP_CLASS:
+            case OP_GET_LOCAL_PROPERTY:
+                return 1;
+            case OP_POP:
+            case OP_DEFINE_GLOBAL:
+            case OP_SET_PROPERTY:
+            case OP_GET_SUPER:
+            case OP_EQUAL:
+            case OP_GREATER:
+            case OP_LESS:
+            case OP_ADD:
+            case OP_SUBTRACT:
+            case OP_MULTIPLY:
+            case OP_DIVIDE:
+            case OP_ADD_NUMBER:
+            case OP_SUBTRACT_NUMBER:
+            case OP_MULTIPLY_NUMBER:
+            case OP_DIVIDE_NUMBER:
+            case OP_GREATER_NUMBER:
+            case OP_LESS_NUMBER:
+            case OP_PRINT:
+            case OP_POP_JUMP_IF_FALSE:
+            case OP_CLOSE_UPVALUE:
+            case OP_INHERIT:
+            case OP_METHOD:
+                return -1;
+            case OP_EQUAL_JUMP_IF_FALSE:
+            case OP_GREATER_JUMP_IF_FALSE:
+            case OP_LESS_JUMP_IF_FALSE:
+                return -2;
+            case OP_CALL:
+            case OP_TAIL_CALL:
+                return -ip[1];
+            case OP_INVOKE:
+                return -ip[2];
+            case OP_SUPER_INVOKE:
+                return -ip[2] - 1;
+            default:
+                return 0;
+        }
+    }
+
+    // 按字节码翻译寄存器代码
+    class RegisterCompiler {
+    public:
+        explicit RegisterCompiler(ObjFunction *function);
+
+        RegisterCode *compile();
+
+    private:
+        ObjFunction *function;
+        Chunk *chunk;
+        RegisterCode *registers;
+        std::vector<Operand> stack;         // 虚拟栈 第i项为槽位i的值所在的操作数 等于i时已写回槽位
+        std::vector<bool> targets;          // 字节码偏移处是否为跳转目标
+        std::vector<int> depths;            // 各指令之前的栈深 执行不到的为-1
+        std::vector<std::pair<size_t, int>> patches;    // 待回填的跳转 指令下标和目标字节码偏移
+        bool reachable;                     // 上一条指令之后会不会顺序执行到下一条
+        int lastWrite;                      // 上一条指令写入的栈顶槽位 改写成直接写局部变量 没有时为-1
+        int offset;                         // 正在翻译的字节码偏移
+
+        int readShort(int at);
+
+        int jumpTarget();
+
+        void findDepths();
+
+        void emit(RegisterOp op, int32_t a, int32_t b, int32_t c, int depth);
+
+        void emit(RegisterOp op, int32_t a, int32_t b, int32_t c);
+
+        void push(Operand operand);
+
+        Operand pop();
+
+        void resetStack(int depth);
+
+        void flush();
+
+        void invalidate(int slot);
+
+        void jump(RegisterOp op, Operand b, Operand c);
+
+        void binary(RegisterOp op);
+
+        void unary(RegisterOp op);
+
+        void setLocal(int slot);
+
+        void exit();
+
+        void translate();
+    };
+
+    RegisterCompiler::RegisterCompiler(ObjFunction *function)
+            : function(function), chunk(function->chunk), registers(new RegisterCode()),
+              reachable(true), lastWrite(-1), offset(0) {}
+
+    int RegisterCompiler::readShort(int at) {
+        return (chunk->code[at] << 8) | chunk->code[at + 1];
+    }
+
+    // 当前跳转指令的目标偏移
+    int RegisterCompiler::jumpTarget() {
+        int end = offset + 3;
+        int jump = readShort(offset + 1);
+        return chunk->code[offset] == OP_LOOP ? end - jump : end + jump;
+    }
+
+    // 沿控制流推算每条指令之前的栈深 同时找出跳转目标
+    // for的增量子句只从循环体末尾跳回 不能按顺序扫描时推算
+    void RegisterCompiler::findDepths() {
+        int count = (int) chunk->code.size();
+        targets.assign(count + 1, false);
+        depths.assign(count + 1, -1);
+        std::vector<int> pending;
+        depths[0] = function->arity + 1;
+        pending.push_back(0);
+        while (!pending.empty()) {
+            offset = pending.back();
+            pending.pop_back();
+            if (offset >= count) continue;
+            uint8_t *ip = &chunk->code[offset];
+            int depth = depths[offset] + stackEffect(ip);
+            int next = offset + chunk->instructionLength(offset);
+            int successors[2] = {next, -1};
+            switch (ip[0]) {
+                case OP_JUMP:
+                case OP_LOOP:
+                    successors[0] = jumpTarget();
+                    targets[successors[0]] = true;
+                    break;
+                case OP_JUMP_IF_FALSE:
+                case OP_POP_JUMP_IF_FALSE:
+                case OP_EQUAL_JUMP_IF_FALSE:
+                case OP_GREATER_JUMP_IF_FALSE:
+                case OP_LESS_JUMP_IF_FALSE:
+                    successors[1] = jumpTarget();
+                    targets[successors[1]] = true;
+                    break;
+                case OP_RETURN:
+                    successors[0] = -1;
+                    break;
+                default:
+                    break;
+            }
+            for (int successor: successors) {
+                if (successor < 0 || depths[successor] >= 0) continue;
+                depths[successor] = depth;
+                pending.push_back(successor);
+            }
+        }
+    }
+
+    void RegisterCompiler::emit(RegisterOp op, int32_t a, int32_t b, int32_t c, int depth) {
+        registers->code.push_back(RegisterInstruction{op, (uint16_t) depth, a, b, c, (uint32_t) offset});
+        lastWrite = -1;
+    }
+
+    void RegisterCompiler::emit(RegisterOp op, int32_t a, int32_t b, int32_t c) {
+        emit(op, a, b, c, (int) stack.size());
+    }
+
+    void RegisterCompiler::push(Operand operand) {
+        stack.push_back(operand);
+    }
+
+    Operand RegisterCompiler::pop() {
+        Operand operand = stack.back();
+        stack.pop_back();
+        return operand;
+    }
+
+    // 栈深为depth 所有值都在自己的槽位中
+    void RegisterCompiler::resetStack(int depth) {
+        stack.resize(depth);
+        for (int i = 0; i < depth; i++) stack[i] = i;
+    }
+
+    // 把虚拟栈写回槽位 之后栈和槽位与解释器一致
+    // 操作数引用的槽位都已写回 写入还没写回的槽位不影响其它值
+    void RegisterCompiler::flush() {
+        for (int i = 0; i < (int) stack.size(); i++) {
+            if (stack[i] == i) continue;
+            emit(R_MOVE, i, stack[i], 0);
+            stack[i] = i;
+        }
+    }
+
+    // 写槽位之前 把还引用它的旧值写回各自的槽位
+    void RegisterCompiler::invalidate(int slot) {
+        for (int i = slot + 1; i < (int) stack.size(); i++) {
+            if (stack[i] != slot) continue;
+            emit(R_MOVE, i, slot, 0);
+            stack[i] = i;
+        }
+    }
+
+    // 条件已从虚拟栈弹出 其余的值写回后跳转 两条路径上的状态一致
+    void RegisterCompiler::jump(RegisterOp op, Operand b, Operand c) {
+        int target = jumpTarget();
+        flush();
+        patches.emplace_back(registers->code.size(), target);
+        emit(op, 0, b, c);
+    }
+
+    void RegisterCompiler::binary(RegisterOp op) {
+        int depth = (int) stack.size();
+        Operand c = pop();
+        Operand b = pop();
+        int slot = (int) stack.size();
+        if (op == R_ADD) {
+            // 拼接字符串可能触发回收 回收扫描到栈深为止 操作数之下的值先写回槽位
+            // 操作数由执行时压栈保护
+            flush();
+            depth = slot;
+        }
+        emit(op, slot, b, c, depth);
+        push(slot);
+        lastWrite = slot;
+    }
+
+    void RegisterCompiler::unary(RegisterOp op) {
+        Operand b = pop();
+        int slot = (int) stack.size();
+        emit(op, slot, b, 0, slot + 1);
+        push(slot);
+        lastWrite = slot;
+    }
+
+    // 赋值表达式的值留在栈顶 栈顶刚由上一条指令算出时改为直接写入局部变量
+    void RegisterCompiler::setLocal(int slot) {
+        invalidate(slot);
+        int top = (int) stack.size() - 1;
+        Operand value = stack[top];
+        if (value == top && lastWrite == top && slot != top) {
+            registers->code.back().a = slot;
+            stack[top] = slot;
+        } else if (value != slot) {
+            emit(R_MOVE, slot, value, 0);
+        }
+        stack[slot] = slot;
+        lastWrite = -1;
+    }
+
+    // 由解释器执行这条指令 之后所有值都在自己的槽位中 可以从下一条指令重新进入
+    void RegisterCompiler::exit() {
+        flush();
+        emit(R_EXIT, offset, 0, 0);
+        resetStack((int) stack.size() + stackEffect(&chunk->code[offset]));
+        registers->entries[offset + chunk->instructionLength(offset)] = (int32_t) registers->code.size();
+    }
+
+    void RegisterCompiler::translate() {
+        uint8_t *ip = &chunk->code[offset];
+        int nil = (int) chunk->constants.size();
+        switch (ip[0]) {
+            case OP_CONSTANT:
+                push(constantOperand(ip[1]));
+                break;
+            case OP_NIL:
+                push(constantOperand(nil));
+                break;
+            case OP_TRUE:
+                push(constantOperand(nil + 1));
+                break;
+            case OP_FALSE:
+                push(constantOperand(nil + 2));
+                break;
+            case OP_POP:
+                pop();
+                break;
+            case OP_GET_LOCAL:
+                push(stack[ip[1]]);
+                break;
+            case OP_SET_LOCAL:
+                setLocal(ip[1]);
+                break;
+            case OP_GET_GLOBAL: {
+                int slot = (int) stack.size();
+                emit(R_GET_GLOBAL, slot, readShort(offset + 1), 0);
+                push(slot);
+                lastWrite = slot;
+                break;
+            }
+            case OP_DEFINE_GLOBAL: {
+                int depth = (int) stack.size();
+                emit(R_DEFINE_GLOBAL, readShort(offset + 1), pop(), 0, depth);
+                break;
+            }
+            case OP_SET_GLOBAL:
+                emit(R_SET_GLOBAL, readShort(offset + 1), stack.back(), 0);
+                break;
+            case OP_EQUAL:
+                binary(R_EQUAL);
+                break;
+            case OP_GREATER:
+            case OP_GREATER_NUMBER:
+                binary(R_GREATER);
+                break;
+            case OP_LESS:
+            case OP_LESS_NUMBER:
+                binary(R_LESS);
+                break;
+            case OP_ADD:
+            case OP_ADD_NUMBER:
+                binary(R_ADD);
+                break;
+            case OP_SUBTRACT:
+            case OP_SUBTRACT_NUMBER:
+                binary(R_SUBTRACT);
+                break;
+            case OP_MULTIPLY:
+            case OP_MULTIPLY_NUMBER:
+                binary(R_MULTIPLY);
+                break;
+            case OP_DIVIDE:
+            case OP_DIVIDE_NUMBER:
+                binary(R_DIVIDE);
+                break;
+            case OP_NOT:
+                unary(R_NOT);
+                break;
+            case OP_NEGATE:
+                unary(R_NEGATE);
+                break;
+            case OP_JUMP:
+                jump(R_JUMP, 0, 0);
+                reachable = false;
+                break;
+            case OP_JUMP_IF_FALSE:
+                // 条件留在栈上 先写回
+                flush();
+                jump(R_JUMP_IF_FALSE, (Operand) stack.size() - 1, 0);
+                break;
+            case OP_POP_JUMP_IF_FALSE: {
+                Operand condition = pop();
+                jump(R_JUMP_IF_FALSE, condition, 0);
+                break;
+            }
+            case OP_EQUAL_JUMP_IF_FALSE:
+            case OP_GREATER_JUMP_IF_FALSE:
+            case OP_LESS_JUMP_IF_FALSE: {
+                Operand c = pop();
+                Operand b = pop();
+                RegisterOp op = ip[0] == OP_EQUAL_JUMP_IF_FALSE ? R_EQUAL_JUMP
+                                                                : ip[0] == OP_GREATER_JUMP_IF_FALSE ? R_GREATER_JUMP
+                                                                                                    : R_LESS_JUMP;
+                jump(op, b, c);
+                break;
+            }
+            case OP_LOOP:
+                jump(R_LOOP, 0, 0);
+                reachable = false;
+                break;
+            case OP_ADD_LOCAL_CONSTANT: {
+                int slot = ip[1];
+                invalidate(slot);
+                emit(R_ADD, slot, stack[slot], constantOperand(ip[2]));
+                stack[slot] = slot;
+                break;
+            }
+            case OP_CALL: {
+                int argCount = ip[1];
+                flush();
+                int base = (int) stack.size() - argCount - 1;
+                emit(R_CALL, base, argCount, offset + 2);
+                resetStack(base + 1);
+                // 被调用的函数在解释器中返回时从这里重新进入
+                registers->entries[offset + 2] = (int32_t) registers->code.size();
+                break;
+            }
+            case OP_RETURN:
+                // 返回前的安全点按栈深扫描槽位
+                flush();
+                emit(R_RETURN, 0, stack.back(), 0);
+                reachable = false;
+                break;
+            default:
+                exit();
+                break;
+        }
+    }
+
+    RegisterCode *RegisterCompiler::compile() {
+        ValueArray &constants = chunk->constants;
+        for (size_t i = 0; i < constants.size(); i++) registers->constants.push_back(constants[i]);
+        registers->constants.push_back(NIL_VAL);
+        registers->constants.push_back(BOOL_VAL(true));
+        registers->constants.push_back(BOOL_VAL(false));
+
+        findDepths();
+        int count = (int) chunk->code.size();
+        registers->entries.assign(count + 1, -1);
+        // 进入函数时栈上是被调用者和参数
+        resetStack(function->arity + 1);
+        registers->entries[0] = 0;
+
+        for (offset = 0; offset < count; offset += chunk->instructionLength(offset)) {
+            // return或无条件跳转之后没有跳转进来的代码执行不到
+            if (depths[offset] < 0) continue;
+            if (!reachable) {
+                resetStack(depths[offset]);
+                reachable = true;
+            } else if (targets[offset]) {
+                flush();
+            }
+            if (targets[offset]) {
+                lastWrite = -1;
+                registers->entries[offset] = (int32_t) registers->code.size();
+            }
+            translate();
+        }
+        // 字节码总以返回结束 不会执行到末尾
+        emit(R_EXIT, count, 0, 0);
+
+        for (auto &patch: patches) {
+            registers->code[patch.first].a = registers->entries[patch.second];
+        }
+
+#ifdef DEBUG_PRINT_CODE
+        disassembleRegisters(registers, function->name != nullptr ? function->name->chars : "<script>");
+#endif
+        return registers;
+    }
+
+    RegisterCode *compileRegisters(ObjFunction *function) {
+        if (function->registers == nullptr) {
+            RegisterCompiler compiler(function);
+            function->registers = compiler.compile();
+        }
+        return function->registers;
+    }
+
+    // 从栈顶帧的ip处进入寄存器代码 调用和返回在寄存器代码之间直接切换帧
+    // 遇到交给解释器的指令 或返回到不能进入的位置时返回true 这时栈顶帧的ip和虚拟机栈顶都已同步
+    bool VM::runRegisters() {
+        CallFrame *frame;
+        Value *slots;
+        const Value *constants;
+        const RegisterInstruction *code;
+        const RegisterInstruction *pc;
+        uint8_t *bytecode;
+
+// 进入栈顶帧 帧的ip处不能进入时交回解释器
+#define ENTER_FRAME() \
+    do { \
+      frame = &this->frames[this->frameCount - 1]; \
+      RegisterCode *registers = compileRegisters(frame->closure->function); \
+      bytecode = frame->closure->function->chunk->code.data(); \
+      int32_t entry = registers->entries[frame->ip - bytecode]; \
+      if (entry < 0) return true; \
+      slots = frame->slots; \
+      constants = registers->constants.data(); \
+      code = registers->code.data(); \
+      pc = code + entry; \
+    } while (false)
+// 读取源操作数
+#define OPERAND(operand) ((operand) >= 0 ? slots[operand] : constants[-1 - (operand)])
+// 报错时帧的ip指向这条指令之后 与解释器一致
+#define RUNTIME_ERROR(...) \
+    do { \
+      frame->ip = bytecode + instruction->origin + 1; \
+      runtimeError(__VA_ARGS__); \
+      return false; \
+    } while (false)
+#define NUMBER_OP(valueType, op) \
+    do { \
+      Value b = OPERAND(instruction->b); \
+      Value c = OPERAND(instruction->c); \
+      if (!IS_NUMBER(b) || !IS_NUMBER(c)) RUNTIME_ERROR("Operands must be numbers."); \
+      slots[instruction->a] = valueType(AS_NUMBER(b) op AS_NUMBER(c)); \
+    } while (false)
+// 比较结果为false时跳转 NaN时跳转
+#define COMPARE_JUMP(op) \
+    do { \
+      Value b = OPERAND(instruction->b); \
+      Value c = OPERAND(instruction->c); \
+      if (!IS_NUMBER(b) || !IS_NUMBER(c)) RUNTIME_ERROR("Operands must be numbers."); \
+      if (!(AS_NUMBER(b) op AS_NUMBER(c))) pc = code + instruction->a; \
+    } while (false)
+// 安全点之前同步ip和栈顶 回收按栈顶扫描槽位 采样按ip取行号
+#define SAFEPOINT() \
+    do { \
+      frame->ip = bytecode + instruction->origin + 1; \
+      this->stackTop = slots + instruction->depth; \
+      if (this->profileTick && this->profiler != nullptr) this->profiler->sample(this); \
+      if (this->nurseryPending || this->bytesAllocated >= this->nextSlice) gcSafepoint(); \
+    } while (false)
+#ifdef DEBUG_OPCODE_STATS
+#define COUNT_INSTRUCTION() (this->opcodeStats.registerInstructions++)
+#else
+#define COUNT_INSTRUCTION() do {} while (false)
+#endif
+
+        ENTER_FRAME();
+        for (;;) {
+            const RegisterInstruction *instruction = pc++;
+            COUNT_INSTRUCTION();
+            switch (instruction->op) {
+                case R_MOVE:
+                    slots[instruction->a] = OPERAND(instruction->b);
+                    break;
+                case R_GET_GLOBAL: {
+                    Value value = this->globals[instruction->b];
+                    if (IS_UNDEFINED(value)) {
+                        RUNTIME_ERROR("Undefined variable '%s'.", globalName(instruction->b)->chars);
+                    }
+                    slots[instruction->a] = value;
+                    break;
+                }
+                case R_DEFINE_GLOBAL:
+                    this->globals[instruction->a] = OPERAND(instruction->b);
+                    break;
+                case R_SET_GLOBAL:
+                    if (IS_UNDEFINED(this->globals[instruction->a])) {
+                        RUNTIME_ERROR("Undefined variable '%s'.", globalName(instruction->a)->chars);
+                    }
+                    this->globals[instruction->a] = OPERAND(instruction->b);
+                    break;
+                case R_ADD: {
+                    Value b = OPERAND(instruction->b);
+                    Value c = OPERAND(instruction->c);
+                    if (IS_NUMBER(b) && IS_NUMBER(c)) {
+                        slots[instruction->a] = NUMBER_VAL(AS_NUMBER(b) + AS_NUMBER(c));
+                    } else if (IS_ANY_STRING(b) && IS_ANY_STRING(c)) {
+                        // 拼接会分配 槽位已写回到depth 操作数放到栈上保护
+                        this->stackTop = slots + instruction->depth;
+                        push(b);
+                        push(c);
+                        concatenate();
+                        slots[instruction->a] = pop();
+                    } else {
+                        RUNTIME_ERROR("Operands must be two numbers or two strings.");
+                    }
+                    break;
+                }
+                case R_SUBTRACT:
+                    NUMBER_OP(NUMBER_VAL, -);
+                    break;
+                case R_MULTIPLY:
+                    NUMBER_OP(NUMBER_VAL, *);
+                    break;
+                case R_DIVIDE:
+                    NUMBER_OP(NUMBER_VAL, /);
+                    break;
+                case R_EQUAL: {
+                    Value b = OPERAND(instruction->b);
+                    Value c = OPERAND(instruction->c);
+                    slots[instruction->a] = BOOL_VAL(b == c);
+                    break;
+                }
+                case R_GREATER:
+                    NUMBER_OP(BOOL_VAL, >);
+                    break;
+                case R_LESS:
+                    NUMBER_OP(BOOL_VAL, <);
+                    break;
+                case R_NOT:
+                    slots[instruction->a] = BOOL_VAL(isFalsey(OPERAND(instruction->b)));
+                    break;
+                case R_NEGATE: {
+                    Value b = OPERAND(instruction->b);
+                    if (!IS_NUMBER(b)) RUNTIME_ERROR("Operand must be a number.");
+                    slots[instruction->a] = NUMBER_VAL(-AS_NUMBER(b));
+                    break;
+                }
+                case R_JUMP:
+                    pc = code + instruction->a;
+                    break;
+                case R_JUMP_IF_FALSE:
+                    if (isFalsey(OPERAND(instruction->b))) pc = code + instruction->a;
+                    break;
+                case R_EQUAL_JUMP: {
+                    Value b = OPERAND(instruction->b);
+                    Value c = OPERAND(instruction->c);
+                    if (!(b == c)) pc = code + instruction->a;
+                    break;
+                }
+                case R_GREATER_JUMP:
+                    COMPARE_JUMP(>);
+                    break;
+                case R_LESS_JUMP:
+                    COMPARE_JUMP(<);
+                    break;
+                case R_LOOP:
+                    SAFEPOINT();
+                    pc = code + instruction->a;
+                    break;
+                case R_CALL: {
+                    // 返回后从调用之后继续 被调用者在解释器中返回时也从这里重新进入
+                    frame->ip = bytecode + instruction->c;
+                    this->stackTop = slots + instruction->a + instruction->b + 1;
+                    if (this->profileTick && this->profiler != nullptr) this->profiler->sample(this);
+                    if (this->nurseryPending || this->bytesAllocated >= this->nextSlice) gcSafepoint();
+                    int frameCount = this->frameCount;
+                    if (!callValue(slots[instruction->a], instruction->b)) return false;
+                    // 原生函数的结果已在槽位a
+                    if (this->frameCount != frameCount) ENTER_FRAME();
+                    break;
+                }
+                case R_RETURN: {
+                    if (this->frameCount == 1) {
+                        // 脚本返回由解释器结束执行
+                        slots[instruction->depth - 1] = OPERAND(instruction->b);
+                        frame->ip = bytecode + instruction->origin;
+                        this->stackTop = slots + instruction->depth;
+                        return true;
+                    }
+                    SAFEPOINT();
+                    Value result = OPERAND(instruction->b);
+                    closeUpvalues(slots);
+                    this->frameCount--;
+                    this->stackTop = slots;
+                    push(result);
+                    ENTER_FRAME();
+                    break;
+                }
+                case R_EXIT:
+                    frame->ip = bytecode + instruction->a;
+                    this->stackTop = slots + instruction->depth;
+                    return true;
+            }
+        }
+
+#undef ENTER_FRAME
+#undef OPERAND
+#undef RUNTIME_ERROR
+#undef NUMBER_OP
+#undef COMPARE_JUMP
+#undef SAFEPOINT
+#undef COUNT_INSTRUCTION
+    }
+
+}
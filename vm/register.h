@@ -0,0 +1,67 @@
+//
+// Created by hlx on 2023/10/4.
+//
+
+#ifndef CPPLOX_REGISTER_H
+#define CPPLOX_REGISTER_H
+
+#include <vector>
+
+#include "common.h"
+#include "object.h"
+
+namespace cpplox {
+
+    // 寄存器指令 三地址 寄存器就是帧的槽位 局部变量和栈上的临时值都直接按下标访问
+    // 源操作数非负时是槽位下标 为负时是常量 -1为第0个常量
+    enum RegisterOp : uint8_t {
+        R_MOVE,             // a = b
+        R_GET_GLOBAL,       // a = 全局变量b
+        R_DEFINE_GLOBAL,    // 全局变量a = b
+        R_SET_GLOBAL,       // 全局变量a = b 未定义时报错
+        R_ADD,              // a = b + c 数字相加或字符串拼接
+        R_SUBTRACT,         // a = b - c
+        R_MULTIPLY,         // a = b * c
+        R_DIVIDE,           // a = b / c
+        R_EQUAL,            // a = b == c
+        R_GREATER,          // a = b > c
+        R_LESS,             // a = b < c
+        R_NOT,              // a = !b
+        R_NEGATE,           // a = -b
+        R_JUMP,             // 跳到第a条指令
+        R_JUMP_IF_FALSE,    // b为假时跳到第a条指令
+        R_EQUAL_JUMP,       // b == c不成立时跳到第a条指令
+        R_GREATER_JUMP,     // b > c不成立时跳到第a条指令
+        R_LESS_JUMP,        // b < c不成立时跳到第a条指令
+        R_LOOP,             // 安全点后跳回第a条指令
+        R_CALL,             // 调用槽位a 参数为之后的b个槽位 结果写回槽位a c为返回后继续的字节码偏移
+        R_RETURN,           // 返回b
+        R_EXIT              // 退出到解释器 从字节码偏移a处继续
+    };
+
+    const int REGISTER_OP_COUNT = R_EXIT + 1;
+
+    struct RegisterInstruction {
+        uint8_t op;
+        uint16_t depth;     // 这条指令之前的栈深 安全点 拼接字符串和退出时按它同步栈顶
+        int32_t a;
+        int32_t b;
+        int32_t c;
+        uint32_t origin;    // 翻译自哪条字节码指令的偏移 报错时定位行号
+    };
+
+    // 函数的寄存器代码
+    struct RegisterCode {
+        std::vector<RegisterInstruction> code;
+        std::vector<Value> constants;       // 函数的常量 之后依次是nil true false 由gc标记和修正
+        std::vector<int32_t> entries;       // 字节码偏移到可以进入的指令下标 栈和寄存器状态不一致处为-1
+    };
+
+    // 按字节码翻译出函数的寄存器代码 已翻译过时直接返回
+    // 静态推算每条指令处的栈深 栈上的第i个值就是槽位i 读局部变量和常量只记在编译期的虚拟栈上
+    // 由使用它的指令直接引用 基本块边界和调用前把虚拟栈写回槽位 不支持的指令退出到解释器执行
+    RegisterCode *compileRegisters(ObjFunction *function);
+
+}
+
+#endif //CPPLOX_REGISTER_H
@@ -0,0 +1,186 @@
+//
+// Created by hlx on 2023/10/4.
+//
+
+#include <cstring>
+
+#include "memory.h"
+#include "object.h"
+#include "table.h"
+
+namespace cpplox {
+
+// 负载因子 超过后扩容
+#define TABLE_MAX_LOAD 0.75
+
+    Table::Table() {
+        this->count = 0;
+        this->capacity = 0;
+        this->entries = nullptr;
+    }
+
+    Table::~Table() {
+        clear();
+    }
+
+    void Table::clear() {
+        // 没有分配过条目时不用经过分配器 虚拟机释放后表仍可以安全析构
+        if (this->entries == nullptr) return;
+        FREE_ARRAY(Entry, this->entries, this->capacity);
+        this->count = 0;
+        this->capacity = 0;
+        this->entries = nullptr;
+    }
+
+    // 查找键所在的条目 不存在时返回第一个可复用的墓碑或空条目
+    static Entry *findEntry(Entry *entries, int capacity, ObjString *key) {
+        uint32_t index = key->hash & (capacity - 1);
+        Entry *tombstone = nullptr;
+
+        for (;;) {
+            Entry *entry = &entries[index];
+            if (entry->key == nullptr) {
+                if (IS_NIL(entry->value)) {
+                    // 空条目
+                    return tombstone != nullptr ? tombstone : entry;
+                } else {
+                    // 墓碑
+                    if (tombstone == nullptr) tombstone = entry;
+                }
+            } else if (entry->key == key) {
+                return entry;
+            }
+
+            index = (index + 1) & (capacity - 1);
+        }
+    }
+
+    bool Table::get(ObjString *key, Value *value) {
+        if (this->count == 0) return false;
+
+        Entry *entry = findEntry(this->entries, this->capacity, key);
+        if (entry->key == nullptr) return false;
+
+        *value = entry->value;
+        return true;
+    }
+
+    void Table::adjustCapacity(int newCapacity) {
+        // 先分配新数组 分配期间可能gc 旧数组仍然有效
+        Entry *newEntries = ALLOCATE(Entry, newCapacity);
+        for (int i = 0; i < newCapacity; i++) {
+            newEntries[i].key = nullptr;
+            newEntries[i].value = NIL_VAL;
+        }
+
+        // 重新插入 丢弃墓碑
+        int newCount = 0;
+        for (int i = 0; i < this->capacity; i++) {
+            Entry *entry = &this->entries[i];
+            if (entry->key == nullptr) continue;
+
+            Entry *dest = findEntry(newEntries, newCapacity, entry->key);
+            dest->key = entry->key;
+            dest->value = entry->value;
+            newCount++;
+        }
+
+        FREE_ARRAY(Entry, this->entries, this->capacity);
+        this->entries = newEntries;
+        this->capacity = newCapacity;
+        this->count = newCount;
+    }
+
+    bool Table::set(ObjString *key, Value value) {
+        if (this->count + 1 > this->capacity * TABLE_MAX_LOAD) {
+            adjustCapacity(GROW_CAPACITY(this->capacity));
+        }
+
+        Entry *entry = findEntry(this->entries, this->capacity, key);
+        bool isNewKey = entry->key == nullptr;
+        // 复用墓碑时count不变
+        if (isNewKey && IS_NIL(entry->value)) this->count++;
+
+        entry->key = key;
+        entry->value = value;
+        return isNewKey;
+    }
+
+    bool Table::remove(ObjString *key) {
+        if (this->count == 0) return false;
+
+        Entry *entry = findEntry(this->entries, this->capacity, key);
+        if (entry->key == nullptr) return false;
+
+        entry->key = nullptr;
+        entry->value = BOOL_VAL(true);
+        return true;
+    }
+
+    void Table::addAll(Table *from) {
+        for (int i = 0; i < from->capacity; i++) {
+            Entry *entry = &from->entries[i];
+            if (entry->key != nullptr) {
+                set(entry->key, entry->value);
+            }
+        }
+    }
+
+    ObjString *Table::findString(const char *chars, int length, uint32_t hash) {
+        if (this->count == 0) return nullptr;
+
+        uint32_t index = hash & (this->capacity - 1);
+        for (;;) {
+            Entry *entry = &this->entries[index];
+            if (entry->key == nullptr) {
+                // 空条目结束探测 墓碑继续
+                if (IS_NIL(entry->value)) return nullptr;
+            } else if (entry->key->hash == hash &&
+                       entry->key->length == length &&
+                       memcmp(entry->key->chars, chars, length) == 0) {
+                return entry->key;
+            }
+
+            index = (index + 1) & (this->capacity - 1);
+        }
+    }
+
+    ObjString *Table::findString(const char *head, int headLength,
+                                 const char *tail, int tailLength, uint32_t hash) {
+        if (this->count == 0) return nullptr;
+
+        int length = headLength + tailLength;
+        uint32_t index = hash & (this->capacity - 1);
+        for (;;) {
+            Entry *entry = &this->entries[index];
+            if (entry->key == nullptr) {
+                if (IS_NIL(entry->value)) return nullptr;
+            } else if (entry->key->hash == hash &&
+                       entry->key->length == length &&
+                       memcmp(entry->key->chars, head, headLength) == 0 &&
+                       memcmp(entry->key->chars + headLength, tail, tailLength) == 0) {
+                return entry->key;
+            }
+
+            index = (index + 1) & (this->capacity - 1);
+        }
+    }
+
+    void markTable(Table *table) {
+        for (int i = 0; i < table->capacity; i++) {
+            Entry *entry = &table->entries[i];
+            markObject((Obj *) entry->key);
+            markValue(entry->value);
+        }
+    }
+
+    void tableRemoveWhite(Table *table) {
+        for (int i = 0; i < table->capacity; i++) {
+            Entry *entry = &table->entries[i];
+            // 新生代的字符串由新生代回收处理
+            if (entry->key != nullptr && !entry->key->isMarked && !isYoung(entry->key)) {
+                table->remove(entry->key);
+            }
+        }
+    }
+}
@@ -0,0 +1,69 @@
+//
+// Created by hlx on 2023/10/4.
+//
+
+#ifndef CPPLOX_TABLE_H
+#define CPPLOX_TABLE_H
+
+#include "common.h"
+#include "value.h"
+
+namespace cpplox {
+
+    class ObjString;
+
+    // 哈希表条目 key为nullptr且value为true时是墓碑
+    struct Entry {
+        ObjString *key;     // 键 驻留后的字符串 直接比较指针
+        Value value;        // 值
+    };
+
+    // 开放寻址哈希表 线性探测 删除留下墓碑 使用字符串驻留时缓存的哈希
+    class Table {
+    public:
+        int count;          // 已用条目数 包含墓碑
+        int capacity;       // 条目数组容量 总是2的幂
+        Entry *entries;     // 条目数组
+
+        Table();
+
+        Table(const Table &) = delete;
+
+        Table &operator=(const Table &) = delete;
+
+        // 查找键 找到时写入value
+        bool get(ObjString *key, Value *value);
+
+        // 写入键值 键是新加入的返回true
+        bool set(ObjString *key, Value value);
+
+        // 删除键 留下墓碑
+        bool remove(ObjString *key);
+
+        // 复制另一个表的全部条目
+        void addAll(Table *from);
+
+        // 按内容查找驻留字符串
+        ObjString *findString(const char *chars, int length, uint32_t hash);
+
+        // 按两段拼接后的内容查找驻留字符串 不需要先拼出结果
+        ObjString *findString(const char *head, int headLength,
+                              const char *tail, int tailLength, uint32_t hash);
+
+        // 释放全部条目
+        void clear();
+
+        ~Table();
+
+    private:
+        void adjustCapacity(int newCapacity);
+    };
+
+    // 标记表中的键和值
+    void markTable(Table *table);
+
+    // 删除未被标记的键 用于字符串驻留表
+    void tableRemoveWhite(Table *table);
+}
+
+#endif //CPPLOX_TABLE_H
@@ -27,6 +27,7 @@ namespace cpplox {
                 printf(AS_BOOL(*this) ? "true" : "false");
                 break;
             case VAL_NIL:
+            case VAL_UNDEFINED: // 不会出现在栈上 按nil打印
                 printf("nil");
                 break;
             case VAL_NUMBER:
@@ -44,7 +45,9 @@ namespace cpplox {
         if (IS_NUMBER((*this)) && IS_NUMBER(other)) {
             return AS_NUMBER((*this)) == AS_NUMBER(other);
         }
-        return this->v == other.v;
+        if (this->v == other.v) return true;
+        // 拼接中的字符串没有驻留 需要按内容比较
+        return IS_OBJ((*this)) && IS_OBJ(other) && stringsEqual(AS_OBJ((*this)), AS_OBJ(other));
 #else
         if (this->type != other.type) return false;
         switch (this->type) {
@@ -55,7 +58,8 @@ namespace cpplox {
             case VAL_NUMBER:
                 return AS_NUMBER(*this) == AS_NUMBER(other);
             case VAL_OBJ: {
-                return AS_OBJ(*this) == AS_OBJ(other);
+                // 拼接中的字符串没有驻留 需要按内容比较
+                return AS_OBJ(*this) == AS_OBJ(other) || stringsEqual(AS_OBJ(*this), AS_OBJ(other));
             }
             default:
                 return false; // Unreachable.
@@ -77,11 +81,15 @@ namespace cpplox {
         }
     }
 
-    Value ValueArray::operator[](size_t index) {
+    Value &ValueArray::operator[](size_t index) {
         return _data[index];
     }
 
     size_t ValueArray::size() {
         return _data.size();
     }
+
+    void ValueArray::truncate(size_t size) {
+        _data.resize(size);
+    }
 }
\ No newline at end of file
@@ -1 +1,1233 @@
-//// Created by hlx on 2023/10/4.//#include "vm.h"#include <cstdarg>#include <cstdio>#include <cstring>#include <ctime>#include "common.h"#include "debug.h"#include "compiler.h"#include "object.h"#include "memory.h"namespace cpplox {    VM vm;    // 时钟原生函数    static Value clockNative(int argCount, Value *args) {        return NUMBER_VAL((double) clock() / CLOCKS_PER_SEC);    }    void initVM() {        vm.resetStack();        vm.objects = nullptr;        vm.bytesAllocated = 0;        vm.nextGC = 1024 * 1024;        vm.grayCount = 0;        vm.grayCapacity = 0;        vm.grayStack = nullptr;        vm.initString = nullptr;        vm.initString = copyString("init");        vm.defineNative("clock", clockNative);    }    void freeVM() {        vm.globals.clear();        vm.strings.clear();        vm.initString = nullptr;        freeObjects();    }    // 是否为false 只要不为空或者布尔false都是true    static bool isFalsey(Value value) {        return IS_NIL(value) || (IS_BOOL(value) && !AS_BOOL(value));    }    InterpretResult VM::interpret(const char *source) {        // 解释时编译        ObjFunction *function = compile(source);        if (function == nullptr) return InterpretResult::COMPILE_ERROR;        push(OBJ_VAL(function));        ObjClosure *closure = newClosure(function);        pop();        push(OBJ_VAL(closure));        call(closure, 0);        return run();    }    void VM::push(Value value) {        *this->stackTop = value;        this->stackTop++;    }    Value VM::pop() {        this->stackTop--;        return *this->stackTop;    }    void VM::resetStack() {        this->stackTop = this->stack;        this->frameCount = 0;        this->openUpvalues = nullptr;    }    void VM::runtimeError(const char *format, ...) {        va_list args;        va_start(args, format);        vfprintf(stderr, format, args);        va_end(args);        fputs("\n", stderr);        for (int i = this->frameCount - 1; i >= 0; i--) {            CallFrame *frame = &this->frames[i];            ObjFunction *function = frame->closure->function;            size_t instruction = frame->ip - function->chunk->code.data() - 1;            fprintf(stderr, "[line %d] in ",                    function->chunk->lines[instruction]);            if (function->name == nullptr) {                fprintf(stderr, "script\n");            } else {                fprintf(stderr, "%s()\n", function->name->chars->c_str());            }        }        resetStack();    }    void VM::defineNative(const std::string& name, NativeFn function) {        push(OBJ_VAL(copyString(name)));        push(OBJ_VAL(newNative(function)));        this->globals[AS_STRING(this->stack[0])] = this->stack[1];        pop();        pop();    }    Value VM::peek(int distance) {        return this->stackTop[-1 - distance];    }    bool VM::call(ObjClosure *closure, int argCount) {        if (argCount != closure->function->arity) {            runtimeError("Expected %d arguments but got %d.", closure->function->arity, argCount);            return false;        }        // 调用栈过长        if (this->frameCount == FRAMES_MAX) {            runtimeError("Stack overflow.");            return false;        }        // 记录新函数栈帧        CallFrame *frame = &this->frames[this->frameCount++];        frame->closure = closure;        frame->ip = closure->function->chunk->code.data();        frame->slots = this->stackTop - argCount - 1;        return true;    }    bool VM::callValue(Value callee, int argCount) {        if (IS_OBJ(callee)) {            switch (OBJ_TYPE(callee)) {                case OBJ_BOUND_METHOD: {                    ObjBoundMethod *bound = AS_BOUND_METHOD(callee);                    this->stackTop[-argCount - 1] = bound->receiver;                    return call(bound->method, argCount);                }                case OBJ_CLASS: {                    ObjClass *klass = AS_CLASS(callee);                    this->stackTop[-argCount - 1] = OBJ_VAL(newInstance(klass));                    if (klass->methods->find(this->initString) != klass->methods->end()) {                        return call(AS_CLOSURE((*klass->methods)[this->initString]), argCount);                    } else if (argCount != 0) {                        runtimeError("Expected 0 arguments but got %d.", argCount);                        return false;                    }                    return true;                }                case OBJ_CLOSURE:                    return call(AS_CLOSURE(callee), argCount);                case OBJ_NATIVE: {                    NativeFn native = AS_NATIVE(callee);                    Value result = native(argCount, this->stackTop - argCount);                    this->stackTop -= argCount + 1;                    push(result);                    return true;                }                default:                    break; // Non-callable object type.            }        }        runtimeError("Can only call functions and classes.");        return false;    }    bool VM::invokeFromClass(ObjClass *klass, ObjString *name, int argCount) {        if (klass->methods->find(name) == klass->methods->end()) {            runtimeError("Undefined property '%s'.", name->chars->c_str());            return false;        }        return call(AS_CLOSURE((*klass->methods)[name]), argCount);    }    bool VM::invoke(ObjString *name, int argCount) {        Value receiver = peek(argCount);        if (!IS_INSTANCE(receiver)) {            runtimeError("Only instances have methods.");            return false;        }        ObjInstance *instance = AS_INSTANCE(receiver);        if (instance->fields->find(name) != instance->fields->end()) {            Value value = (*instance->fields)[name];            this->stackTop[-argCount - 1] = value;            return callValue(value, argCount);        }        return invokeFromClass(instance->klass, name, argCount);    }    bool VM::bindMethod(ObjClass *klass, ObjString *name) {        if (klass->methods->find(name) == klass->methods->end()) {            runtimeError("Undefined property '%s'.", name->chars->c_str());            return false;        }        ObjBoundMethod *bound = newBoundMethod(peek(0),                                               AS_CLOSURE((*klass->methods)[name]));        pop();        push(OBJ_VAL(bound));        return true;    }    ObjUpvalue *VM::captureUpvalue(Value *local) {        ObjUpvalue *prevUpvalue = nullptr;        ObjUpvalue *upvalue = this->openUpvalues;        while (upvalue != nullptr && upvalue->location > local) {            prevUpvalue = upvalue;            upvalue = upvalue->next;        }        if (upvalue != nullptr && upvalue->location == local) {            return upvalue;        }        ObjUpvalue *createdUpvalue = newUpvalue(local);        createdUpvalue->next = upvalue;        if (prevUpvalue == nullptr) {            this->openUpvalues = createdUpvalue;        } else {            prevUpvalue->next = createdUpvalue;        }        return createdUpvalue;    }    void VM::closeUpvalues(Value *last) {        while (this->openUpvalues != nullptr && this->openUpvalues->location >= last) {            ObjUpvalue *upvalue = this->openUpvalues;            upvalue->closed = *upvalue->location;            upvalue->location = &upvalue->closed;            this->openUpvalues = upvalue->next;        }    }    void VM::defineMethod(ObjString *name) {        Value method = peek(0);        ObjClass *klass = AS_CLASS(peek(1));        (*klass->methods)[name] = method;        pop();    }    void VM::concatenate() {        ObjString *b = AS_STRING(peek(0));        ObjString *a = AS_STRING(peek(1));        std::string chars = *a->chars + *b->chars;        compute(0, chars.capacity());        ObjString *result = takeString(std::move(chars));        pop();        pop();        push(OBJ_VAL(result));    }    InterpretResult VM::run() {        // 拿到vm中的栈帧        CallFrame *frame = &this->frames[this->frameCount - 1];// 读取字节码块单个字节#define READ_BYTE() (*frame->ip++)// 读取常量，在读取单个字节后再读取单个字节的值为常量数组的索引#define READ_SHORT() (frame->ip += 2, (uint16_t)((frame->ip[-2] << 8) | frame->ip[-1]))// 读取常量，在读取单个字节后再读取单个字节的值为常量数组的索引#define READ_CONSTANT() \    (frame->closure->function->chunk->constants[READ_BYTE()])// 读取常量后 转化为值字符串#define READ_STRING() AS_STRING(READ_CONSTANT())// 模拟二元运算#define BINARY_OP(valueType, op) \    do { \      if (!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1))) { \        runtimeError("Operands must be numbers."); \        return InterpretResult::RUNTIME_ERROR; \      } \      double b = AS_NUMBER(pop()); \      double a = AS_NUMBER(pop()); \      push(valueType(a op b)); \    } while (false)        for (;;) {// debug 轨迹 执行#ifdef DEBUG_TRACE_EXECUTION            // 打印虚拟机栈的内容        printf("          ");        for (Value *slot = this->stack; slot < this->stackTop; slot++) {            printf("[ ");            slot->print();            printf(" ]");        }        printf("\n");        // 反汇编        disassembleInstruction(frame->closure->function->chunk,        (int)(frame->ip - frame->closure->function->chunk->code.data()));#endif            uint8_t instruction = READ_BYTE();            switch (instruction) {                case OP_CONSTANT: {                    Value constant = READ_CONSTANT();                    push(constant);                    break;                }                case OP_NIL:                    push(NIL_VAL);                    break;                case OP_TRUE:                    push(BOOL_VAL(true));                    break;                case OP_FALSE:                    push(BOOL_VAL(false));                    break;                case OP_POP:                    pop();                    break;                case OP_GET_LOCAL: {                    uint8_t slot = READ_BYTE();                    push(frame->slots[slot]);                    break;                }                case OP_SET_LOCAL: {                    uint8_t slot = READ_BYTE();                    frame->slots[slot] = peek(0);                    break;                }                case OP_GET_GLOBAL: {                    ObjString *name = READ_STRING();                    printf("name: %s\n", name->chars->c_str());                    if (this->globals.find(name) == this->globals.end()) {                        runtimeError("Undefined variable '%s'.", name->chars->c_str());                        return InterpretResult::RUNTIME_ERROR;                    }                    push(this->globals[name]);                    break;                }                case OP_DEFINE_GLOBAL: {                    ObjString *name = READ_STRING();                    this->globals[name] = peek(0);                    pop();                    break;                }                case OP_SET_GLOBAL: {                    ObjString *name = READ_STRING();                    if (this->globals.find(name) == this->globals.end()) {                        runtimeError("Undefined variable '%s'.", name->chars->c_str());                        return InterpretResult::RUNTIME_ERROR;                    }                    this->globals[name] = peek(0);                    break;                }                case OP_GET_UPVALUE: {                    uint8_t slot = READ_BYTE();                    push(*frame->closure->upvalues[slot]->location);                    break;                }                case OP_SET_UPVALUE: {                    uint8_t slot = READ_BYTE();                    *frame->closure->upvalues[slot]->location = peek(0);                    break;                }                case OP_GET_PROPERTY: {                    if (!IS_INSTANCE(peek(0))) {                        runtimeError("Only instances have properties.");                        return InterpretResult::RUNTIME_ERROR;                    }                    ObjInstance *instance = AS_INSTANCE(peek(0));                    ObjString *name = READ_STRING();                    if (instance->fields->find(name) != instance->fields->end()) {                        pop(); // Instance.                        push((*instance->fields)[name]);                        break;                    }                    if (!bindMethod(instance->klass, name)) {                        return InterpretResult::RUNTIME_ERROR;                    }                    break;                }                case OP_SET_PROPERTY: {                    if (!IS_INSTANCE(peek(1))) {                        runtimeError("Only instances have fields.");                        return InterpretResult::RUNTIME_ERROR;                    }                    ObjInstance *instance = AS_INSTANCE(peek(1));                    (*instance->fields)[READ_STRING()] = peek(0);                    Value value = pop();                    pop();                    push(value);                    break;                }                case OP_GET_SUPER: {                    ObjString *name = READ_STRING();                    ObjClass *superclass = AS_CLASS(pop());                    if (!bindMethod(superclass, name)) {                        return InterpretResult::RUNTIME_ERROR;                    }                    break;                }                case OP_EQUAL: {                    Value b = pop();                    Value a = pop();                    push(BOOL_VAL((a == b)));                    break;                }                case OP_GREATER:                    BINARY_OP(BOOL_VAL, >);                    break;                case OP_LESS:                    BINARY_OP(BOOL_VAL, <);                    break;                case OP_ADD: {                    if (IS_STRING(peek(0)) && IS_STRING(peek(1))) {                        concatenate();                    } else if (IS_NUMBER(peek(0)) && IS_NUMBER(peek(1))) {                        double b = AS_NUMBER(pop());                        double a = AS_NUMBER(pop());                        push(NUMBER_VAL(a + b));                    } else {                        runtimeError(                                "Operands must be two numbers or two strings.");                        return InterpretResult::RUNTIME_ERROR;                    }                    break;                }                case OP_SUBTRACT:                    BINARY_OP(NUMBER_VAL, -);                    break;                case OP_MULTIPLY:                    BINARY_OP(NUMBER_VAL, *);                    break;                case OP_DIVIDE:                    BINARY_OP(NUMBER_VAL, /);                    break;                case OP_NOT:                    push(BOOL_VAL(isFalsey(pop())));                    break;                case OP_NEGATE:                    if (!IS_NUMBER(peek(0))) {                        runtimeError("Operand must be a number.");                        return InterpretResult::RUNTIME_ERROR;                    }                    push(NUMBER_VAL(-AS_NUMBER(pop())));                    break;                case OP_PRINT: {                    pop().print();                    printf("\n");                    break;                }                case OP_JUMP: {                    uint16_t offset = READ_SHORT();                    frame->ip += offset;                    break;                }                case OP_JUMP_IF_FALSE: {                    uint16_t offset = READ_SHORT();                    if (isFalsey(peek(0))) frame->ip += offset;                    break;                }                case OP_LOOP: {                    uint16_t offset = READ_SHORT();                    frame->ip -= offset;                    break;                }                case OP_CALL: {                    int argCount = READ_BYTE();                    if (!callValue(peek(argCount), argCount)) {                        return InterpretResult::RUNTIME_ERROR;                    }                    // 调用成功后将栈帧还回去                    frame = &this->frames[this->frameCount - 1];                    break;                }                case OP_INVOKE: {                    ObjString *method = READ_STRING();                    int argCount = READ_BYTE();                    if (!invoke(method, argCount)) {                        return InterpretResult::RUNTIME_ERROR;                    }                    frame = &this->frames[this->frameCount - 1];                    break;                }                case OP_SUPER_INVOKE: {                    ObjString *method = READ_STRING();                    int argCount = READ_BYTE();                    ObjClass *superclass = AS_CLASS(pop());                    if (!invokeFromClass(superclass, method, argCount)) {                        return InterpretResult::RUNTIME_ERROR;                    }                    frame = &this->frames[this->frameCount - 1];                    break;                }                case OP_CLOSURE: {                    ObjFunction *function = AS_FUNCTION(READ_CONSTANT());                    ObjClosure *closure = newClosure(function);                    push(OBJ_VAL(closure));                    for (int i = 0; i < closure->upvalueCount; i++) {                        uint8_t isLocal = READ_BYTE();                        uint8_t index = READ_BYTE();                        if (isLocal) {                            closure->upvalues[i] = captureUpvalue(frame->slots + index);                        } else {                            closure->upvalues[i] = frame->closure->upvalues[index];                        }                    }                    break;                }                case OP_CLOSE_UPVALUE:                    closeUpvalues(this->stackTop - 1);                    pop();                    break;                case OP_RETURN: {                    Value result = pop();                    closeUpvalues(frame->slots);                    this->frameCount--;                    if (this->frameCount == 0) {                        pop();                        return InterpretResult::OK;                    }                    this->stackTop = frame->slots;                    push(result);                    frame = &this->frames[this->frameCount - 1];                    break;                }                case OP_CLASS:                    push(OBJ_VAL(newClass(READ_STRING())));                    break;                case OP_INHERIT: {                    Value superclass = peek(1);                    if (!IS_CLASS(superclass)) {                        runtimeError("Superclass must be a class.");                        return InterpretResult::RUNTIME_ERROR;                    }                    ObjClass *subclass = AS_CLASS(peek(0));                    Table *from = AS_CLASS(superclass)->methods;                    subclass->methods->insert(from->begin(), from->end());                    pop(); // Subclass.                    break;                }                case OP_METHOD:                    defineMethod(READ_STRING());                    break;            }        }#undef READ_BYTE#undef READ_SHORT#undef READ_CONSTANT#undef READ_STRING#undef BINARY_OP    }}
\ No newline at end of file
+//
+// Created by hlx on 2023/10/4.
+//
+
+#include "vm.h"
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#ifdef DEBUG_OPCODE_CYCLES
+#include <x86intrin.h>
+#endif
+
+#include "common.h"
+#include "debug.h"
+#include "compiler.h"
+#include "jit.h"
+#include "object.h"
+#include "memory.h"
+#include "profiler.h"
+
+namespace cpplox {
+
+    thread_local VM *vm = nullptr;
+
+    // 时钟原生函数
+    static Value clockNative(int argCount, Value *args) {
+        return NUMBER_VAL((double) clock() / CLOCKS_PER_SEC);
+    }
+
+    void initVM(VM *instance) {
+        vm = instance;
+        vm->frames = nullptr;
+        vm->stack = nullptr;
+        vm->globals = nullptr;
+        vm->globalCount = 0;
+        vm->globalCapacity = 0;
+        vm->configureStack(STACK_INITIAL, STACK_MAX, FRAMES_INITIAL, FRAMES_MAX);
+        vm->objects = nullptr;
+        vm->bytesAllocated = 0;
+        vm->nextGC = 1024 * 1024;
+
+        vm->grayCount = 0;
+        vm->grayCapacity = 0;
+        vm->grayStack = nullptr;
+        vm->gcPhase = GcPhase::IDLE;
+        vm->sweepList = nullptr;
+        vm->nextSlice = SIZE_MAX;
+        vm->gcPauseBudget = 0;
+
+        vm->nursery = (uint8_t *) malloc(NURSERY_SIZE);
+        if (vm->nursery == nullptr) exit(1);
+        vm->nurseryTop = vm->nursery;
+        vm->nurseryEnd = vm->nursery + NURSERY_SIZE;
+        vm->nurseryPending = false;
+        vm->rememberedCount = 0;
+        vm->rememberedCapacity = 0;
+        vm->rememberedSet = nullptr;
+
+        vm->internHits = 0;
+        vm->internMisses = 0;
+
+        vm->jitEnabled = true;
+        vm->jitThreshold = JIT_THRESHOLD;
+        vm->registerEnabled = false;
+        vm->profiler = nullptr;
+        vm->profileTick = 0;
+#ifdef DEBUG_OPCODE_STATS
+        memset(&vm->opcodeStats, 0, sizeof(OpcodeStats));
+        vm->opcodeStats.previous = -1;
+#endif
+
+        vm->initString = nullptr;
+        vm->rootShape = new Shape(nullptr, nullptr);
+        vm->initString = copyString("init", 4);
+
+        vm->defineNative("clock", clockNative);
+    }
+
+    void freeVM(VM *instance) {
+        vm = instance;
+#ifdef DEBUG_STRING_STATS
+        fprintf(stderr, "intern hits %zu misses %zu\n", vm->internHits, vm->internMisses);
+#endif
+#ifdef DEBUG_OPCODE_STATS
+        printOpcodeStats(stderr, &vm->opcodeStats);
+#endif
+        vm->globalNames.clear();
+        FREE_ARRAY(Value, vm->globals, vm->globalCapacity);
+        vm->globals = nullptr;
+        vm->globalCount = 0;
+        vm->globalCapacity = 0;
+        vm->strings.clear();
+        vm->initString = nullptr;
+        delete vm->rootShape;
+        vm->rootShape = nullptr;
+        freeObjects();
+        vm->pool.clear();
+        free(vm->nursery);
+        vm->nursery = nullptr;
+        free(vm->frames);
+        vm->frames = nullptr;
+        free(vm->stack);
+        vm->stack = nullptr;
+        vm = nullptr;
+    }
+
+#ifdef DEBUG_OPCODE_STATS
+    static inline void countOpcode(OpcodeStats *stats, uint8_t opcode) {
+#ifdef DEBUG_OPCODE_CYCLES
+        uint64_t now = __rdtsc();
+        if (stats->previous >= 0) stats->cycles[stats->previous] += now - stats->start;
+        stats->start = now;
+#endif
+        stats->counts[opcode]++;
+        if (stats->previous >= 0) stats->pairs[stats->previous][opcode]++;
+        stats->previous = opcode;
+    }
+#endif
+
+    // 函数调用或循环回跳一次 达到阈值时编译成机器码
+    static inline void heatUp(VM *machine, ObjFunction *function) {
+#ifdef JIT
+        if (++function->hotness == machine->jitThreshold && machine->jitEnabled) jitCompile(machine, function);
+#else
+        (void) machine;
+        (void) function;
+#endif
+    }
+
+    InterpretResult VM::interpret(const char *source) {
+        // 编译和执行期间的分配都归这个虚拟机
+        vm = this;
+        // 解释时编译
+        ObjFunction *function = compile(source);
+        if (function == nullptr) return InterpretResult::COMPILE_ERROR;
+
+        return interpret(function);
+    }
+
+    InterpretResult VM::interpret(ObjFunction *function) {
+        vm = this;
+        push(OBJ_VAL(function));
+
+        ObjClosure *closure = newClosure(function);
+        pop();
+        push(OBJ_VAL(closure));
+        call(closure, 0);
+
+        return run();
+    }
+
+    void VM::push(Value value) {
+        *this->stackTop = value;
+        this->stackTop++;
+    }
+
+    Value VM::pop() {
+        this->stackTop--;
+        return *this->stackTop;
+    }
+
+    void VM::resetStack() {
+        this->stackTop = this->stack;
+        this->frameCount = 0;
+        this->openUpvalues = nullptr;
+    }
+
+    void VM::configureStack(size_t stackInitial, size_t stackLimit, int framesInitial, int framesLimit) {
+        this->stackMax = stackLimit < STACK_FRAME_RESERVE ? STACK_FRAME_RESERVE : stackLimit;
+        this->stackCapacity = stackInitial < STACK_FRAME_RESERVE ? STACK_FRAME_RESERVE : stackInitial;
+        if (this->stackCapacity > this->stackMax) this->stackCapacity = this->stackMax;
+        this->framesMax = framesLimit < 1 ? 1 : framesLimit;
+        this->frameCapacity = framesInitial < 1 ? 1 : framesInitial;
+        if (this->frameCapacity > this->framesMax) this->frameCapacity = this->framesMax;
+
+        this->stack = (Value *) realloc(this->stack, sizeof(Value) * this->stackCapacity);
+        this->frames = (CallFrame *) realloc(this->frames, sizeof(CallFrame) * this->frameCapacity);
+        if (this->stack == nullptr || this->frames == nullptr) exit(1);
+        resetStack();
+    }
+
+    // 栈帧数组扩容 其中只有下标有意义 不需要修正指针
+    bool VM::growFrames() {
+        if (this->frameCapacity >= this->framesMax) return false;
+        int capacity = this->frameCapacity * 2;
+        if (capacity > this->framesMax) capacity = this->framesMax;
+        auto *frames = (CallFrame *) realloc(this->frames, sizeof(CallFrame) * capacity);
+        if (frames == nullptr) exit(1);
+        this->frames = frames;
+        this->frameCapacity = capacity;
+        return true;
+    }
+
+    // 虚拟机栈扩容到栈顶之上至少有needed个空位
+    // 栈会移动 修正栈顶 各栈帧的局部变量起点和未关闭的提升值
+    bool VM::growStack(size_t needed) {
+        size_t count = this->stackTop - this->stack;
+        if (count + needed > this->stackMax) return false;
+        size_t capacity = this->stackCapacity;
+        while (capacity < count + needed) capacity *= 2;
+        if (capacity > this->stackMax) capacity = this->stackMax;
+
+        auto *stack = (Value *) malloc(sizeof(Value) * capacity);
+        if (stack == nullptr) exit(1);
+        memcpy(stack, this->stack, sizeof(Value) * count);
+
+        Value *old = this->stack;
+        for (int i = 0; i < this->frameCount; i++) {
+            this->frames[i].slots = stack + (this->frames[i].slots - old);
+        }
+        for (ObjUpvalue *upvalue = this->openUpvalues; upvalue != nullptr; upvalue = upvalue->next) {
+            upvalue->location = stack + (upvalue->location - old);
+        }
+        free(old);
+
+        this->stack = stack;
+        this->stackTop = stack + count;
+        this->stackCapacity = capacity;
+        return true;
+    }
+
+    // 运行时错误的调用栈两端各打印的帧数
+    static const int TRACE_FRAMES = 32;
+
+    void VM::runtimeError(const char *format, ...) {
+        va_list args;
+        va_start(args, format);
+        vfprintf(stderr, format, args);
+        va_end(args);
+        fputs("\n", stderr);
+
+        for (int i = this->frameCount - 1; i >= 0; i--) {
+            // 调用栈很深时只打印两端的栈帧
+            if (i == this->frameCount - 1 - TRACE_FRAMES && i >= TRACE_FRAMES) {
+                fprintf(stderr, "... %d more frames\n", i - TRACE_FRAMES + 1);
+                // 跳过的帧之后接着打印最外层的TRACE_FRAMES个栈帧
+                i = TRACE_FRAMES - 1;
+            }
+            CallFrame *frame = &this->frames[i];
+            ObjFunction *function = frame->closure->function;
+            size_t instruction = frame->ip - function->chunk->code.data() - 1;
+            fprintf(stderr, "[line %d] in ",
+                    function->chunk->lines[instruction]);
+            if (function->name == nullptr) {
+                fprintf(stderr, "script\n");
+            } else {
+                fprintf(stderr, "%s()\n", function->name->chars);
+            }
+        }
+        resetStack();
+    }
+
+    void VM::defineNative(const char *name, NativeFn function) {
+        vm = this;
+        push(OBJ_VAL(copyString(name, (int) strlen(name))));
+        push(OBJ_VAL(newNative(function)));
+        int slot = globalSlot(AS_STRING(this->stack[0]));
+        this->globals[slot] = this->stack[1];
+        pop();
+        pop();
+    }
+
+    int VM::globalSlot(ObjString *name) {
+        Value slot;
+        if (this->globalNames.get(name, &slot)) return (int) AS_NUMBER(slot);
+
+        // 扩容和写入映射都可能触发gc 名字放到栈上保护
+        push(OBJ_VAL(name));
+        if (this->globalCapacity < this->globalCount + 1) {
+            int oldCapacity = this->globalCapacity;
+            this->globalCapacity = GROW_CAPACITY(oldCapacity);
+            this->globals = GROW_ARRAY(Value, this->globals, oldCapacity, this->globalCapacity);
+        }
+        this->globals[this->globalCount] = UNDEFINED_VAL;
+
+        this->globalNames.set(name, NUMBER_VAL((double) this->globalCount));
+        pop();
+        return this->globalCount++;
+    }
+
+    ObjString *VM::globalName(int slot) {
+        for (int i = 0; i < this->globalNames.capacity; i++) {
+            Entry *entry = &this->globalNames.entries[i];
+            if (entry->key != nullptr && AS_NUMBER(entry->value) == slot) return entry->key;
+        }
+        return nullptr;
+    }
+
+    void VM::truncateGlobals(int count) {
+        if (count >= this->globalCount) return;
+        for (int i = 0; i < this->globalNames.capacity; i++) {
+            Entry *entry = &this->globalNames.entries[i];
+            if (entry->key != nullptr && AS_NUMBER(entry->value) >= count) this->globalNames.remove(entry->key);
+        }
+        this->globalCount = count;
+    }
+
+    Value VM::peek(int distance) {
+        return this->stackTop[-1 - distance];
+    }
+
+    bool VM::call(ObjClosure *closure, int argCount) {
+        if (argCount != closure->function->arity) {
+            runtimeError("Expected %d arguments but got %d.", closure->function->arity, argCount);
+            return false;
+        }
+        // 调用栈过长
+        if ((this->frameCount == this->frameCapacity && !growFrames()) ||
+            ((size_t) (this->stack + this->stackCapacity - this->stackTop) < STACK_FRAME_RESERVE &&
+             !growStack(STACK_FRAME_RESERVE))) {
+            runtimeError("Stack overflow.");
+            return false;
+        }
+        heatUp(this, closure->function);
+        // 记录新函数栈帧
+        CallFrame *frame = &this->frames[this->frameCount++];
+        frame->closure = closure;
+        frame->ip = closure->function->chunk->code.data();
+        frame->slots = this->stackTop - argCount - 1;
+        return true;
+    }
+
+    bool VM::callValue(Value callee, int argCount) {
+        if (IS_OBJ(callee)) {
+            switch (OBJ_TYPE(callee)) {
+                case OBJ_BOUND_METHOD: {
+                    ObjBoundMethod *bound = AS_BOUND_METHOD(callee);
+                    this->stackTop[-argCount - 1] = bound->receiver;
+                    return call(bound->method, argCount);
+                }
+                case OBJ_CLASS: {
+                    ObjClass *klass = AS_CLASS(callee);
+                    this->stackTop[-argCount - 1] = OBJ_VAL(newInstance(klass));
+                    Value initializer;
+                    if (klass->methods->get(this->initString, &initializer)) {
+                        return call(AS_CLOSURE(initializer), argCount);
+                    } else if (argCount != 0) {
+                        runtimeError("Expected 0 arguments but got %d.", argCount);
+                        return false;
+                    }
+                    return true;
+                }
+                case OBJ_CLOSURE:
+                    return call(AS_CLOSURE(callee), argCount);
+                case OBJ_NATIVE: {
+                    NativeFn native = AS_NATIVE(callee);
+                    Value result = native(argCount, this->stackTop - argCount);
+                    this->stackTop -= argCount + 1;
+                    push(result);
+                    return true;
+                }
+                default:
+                    break; // Non-callable object type.
+            }
+        }
+        runtimeError("Can only call functions and classes.");
+        return false;
+    }
+
+    bool VM::tailCall(Value callee, int argCount) {
+        ObjClosure *closure;
+        if (IS_CLOSURE(callee)) {
+            closure = AS_CLOSURE(callee);
+        } else if (IS_BOUND_METHOD(callee)) {
+            ObjBoundMethod *bound = AS_BOUND_METHOD(callee);
+            this->stackTop[-argCount - 1] = bound->receiver;
+            closure = bound->method;
+        } else {
+            // 类和原生函数按普通调用处理 随后的OP_RETURN负责返回
+            return callValue(callee, argCount);
+        }
+
+        if (argCount != closure->function->arity) {
+            runtimeError("Expected %d arguments but got %d.", closure->function->arity, argCount);
+            return false;
+        }
+
+        // 关闭当前函数的提升值后 把被调用者和参数移到当前栈帧的起点
+        CallFrame *frame = &this->frames[this->frameCount - 1];
+        closeUpvalues(frame->slots);
+        Value *callArgs = this->stackTop - argCount - 1;
+        memmove(frame->slots, callArgs, sizeof(Value) * (argCount + 1));
+        this->stackTop = frame->slots + argCount + 1;
+
+        frame->closure = closure;
+        frame->ip = closure->function->chunk->code.data();
+        heatUp(this, closure->function);
+        return true;
+    }
+
+    bool VM::findMethod(ObjClass *klass, ObjString *name, InlineCache *cache, Value *method) {
+        CacheEntry *entry = nullptr;
+        for (int i = 0; i < cache->count; i++) {
+            CacheEntry *item = &cache->entries[i];
+            if (item->shape == nullptr && item->klass == klass) {
+                if (item->version == klass->version) {
+                    *method = item->method;
+                    return true;
+                }
+                // 类的方法表已变化 重新查找后覆盖该条目
+                entry = item;
+                break;
+            }
+        }
+
+        Value found;
+        if (!klass->methods->get(name, &found)) return false;
+
+        // 缓存条目没有写屏障 只缓存老年代的类和方法 尽快回收新生代让它们晋升
+        if (isYoung(klass) || isYoungValue(found)) {
+            this->nurseryPending = true;
+            *method = found;
+            return true;
+        }
+
+        // 新的类 缓存未满时追加 单态升级为多态
+        if (entry == nullptr && cache->count < INLINE_CACHE_SIZE) {
+            entry = &cache->entries[cache->count++];
+        }
+        if (entry != nullptr) {
+            entry->shape = nullptr;
+            entry->klass = klass;
+            entry->version = klass->version;
+            entry->slot = -1;
+            entry->transition = nullptr;
+            entry->method = found;
+        }
+
+        *method = found;
+        return true;
+    }
+
+    bool VM::findProperty(ObjInstance *instance, ObjString *name, InlineCache *cache, Value *value, bool *isField) {
+        Shape *shape = instance->shape;
+        ObjClass *klass = instance->klass;
+
+        // 字典模式不缓存 先字段后方法
+        if (shape == nullptr) {
+            if (instanceGet(instance, name, value)) {
+                *isField = true;
+                return true;
+            }
+            if (!klass->methods->get(name, value)) return false;
+            *isField = false;
+            return true;
+        }
+
+        CacheEntry *entry = nullptr;
+        for (int i = 0; i < cache->count; i++) {
+            CacheEntry *item = &cache->entries[i];
+            if (item->shape != shape) continue;
+            // 形状决定了字段布局 字段命中与类无关
+            if (item->slot >= 0) {
+                *value = instance->slots()[item->slot];
+                *isField = true;
+                return true;
+            }
+            if (item->klass == klass) {
+                if (item->version == klass->version) {
+                    *value = item->method;
+                    *isField = false;
+                    return true;
+                }
+                entry = item;
+                break;
+            }
+        }
+
+        int slot = shape->lookup(name);
+        if (slot != -1) {
+            *value = instance->slots()[slot];
+        } else if (!klass->methods->get(name, value)) {
+            return false;
+        }
+        *isField = slot != -1;
+
+        // 缓存条目没有写屏障 只缓存老年代的类和方法 尽快回收新生代让它们晋升
+        if (isYoung(klass) || (slot == -1 && isYoungValue(*value))) {
+            this->nurseryPending = true;
+            return true;
+        }
+
+        if (entry == nullptr && cache->count < INLINE_CACHE_SIZE) {
+            entry = &cache->entries[cache->count++];
+        }
+        if (entry != nullptr) {
+            entry->shape = shape;
+            entry->klass = klass;
+            entry->version = klass->version;
+            entry->slot = slot;
+            entry->transition = shape;
+            entry->method = slot == -1 ? *value : NIL_VAL;
+        }
+        return true;
+    }
+
+    void VM::setProperty(ObjInstance *instance, ObjString *name, Value value, InlineCache *cache) {
+        writeBarrier(instance, value);
+
+        Shape *shape = instance->shape;
+        if (shape != nullptr) {
+            for (int i = 0; i < cache->count; i++) {
+                CacheEntry *item = &cache->entries[i];
+                if (item->shape != shape) continue;
+                // 新字段 沿缓存的转移切换形状
+                if (item->transition != shape) {
+                    instanceReserve(instance, item->transition->slotCount);
+                    instance->slots()[item->slot] = value;
+                    instance->shape = item->transition;
+                    if (item->transition->slotCount > instance->klass->slotHint) {
+                        instance->klass->slotHint = item->transition->slotCount;
+                    }
+                    return;
+                }
+                instance->slots()[item->slot] = value;
+                return;
+            }
+        }
+
+        instanceSet(instance, name, value);
+
+        // 字典模式不缓存 缓存条目没有写屏障 只缓存老年代的类
+        if (shape == nullptr || instance->shape == nullptr || cache->count >= INLINE_CACHE_SIZE) return;
+        if (isYoung(instance->klass)) {
+            this->nurseryPending = true;
+            return;
+        }
+        CacheEntry *entry = &cache->entries[cache->count++];
+        entry->shape = shape;
+        entry->klass = instance->klass;
+        entry->version = 0;
+        entry->slot = instance->shape->lookup(name);
+        entry->transition = instance->shape;
+        entry->method = NIL_VAL;
+    }
+
+    bool VM::invokeFromClass(ObjClass *klass, ObjString *name, int argCount, InlineCache *cache) {
+        Value method;
+        if (!findMethod(klass, name, cache, &method)) {
+            runtimeError("Undefined property '%s'.", name->chars);
+            return false;
+        }
+        return call(AS_CLOSURE(method), argCount);
+    }
+
+    bool VM::invoke(ObjString *name, int argCount, InlineCache *cache) {
+        Value receiver = peek(argCount);
+
+        if (!IS_INSTANCE(receiver)) {
+            runtimeError("Only instances have methods.");
+            return false;
+        }
+
+        ObjInstance *instance = AS_INSTANCE(receiver);
+
+        Value value;
+        bool isField;
+        if (!findProperty(instance, name, cache, &value, &isField)) {
+            runtimeError("Undefined property '%s'.", name->chars);
+            return false;
+        }
+
+        // 字段中存放的可调用对象
+        if (isField) {
+            this->stackTop[-argCount - 1] = value;
+            return callValue(value, argCount);
+        }
+        return call(AS_CLOSURE(value), argCount);
+    }
+
+    bool VM::bindMethod(ObjClass *klass, ObjString *name, InlineCache *cache) {
+        Value method;
+        if (!findMethod(klass, name, cache, &method)) {
+            runtimeError("Undefined property '%s'.", name->chars);
+            return false;
+        }
+
+        ObjBoundMethod *bound = newBoundMethod(peek(0), AS_CLOSURE(method));
+        pop();
+        push(OBJ_VAL(bound));
+        return true;
+    }
+
+    ObjUpvalue *VM::captureUpvalue(Value *local) {
+        ObjUpvalue *prevUpvalue = nullptr;
+        ObjUpvalue *upvalue = this->openUpvalues;
+        while (upvalue != nullptr && upvalue->location > local) {
+            prevUpvalue = upvalue;
+            upvalue = upvalue->next;
+        }
+
+        if (upvalue != nullptr && upvalue->location == local) {
+            return upvalue;
+        }
+
+        ObjUpvalue *createdUpvalue = newUpvalue(local);
+
+        createdUpvalue->next = upvalue;
+
+        if (prevUpvalue == nullptr) {
+            this->openUpvalues = createdUpvalue;
+        } else {
+            prevUpvalue->next = createdUpvalue;
+        }
+
+        return createdUpvalue;
+    }
+
+    void VM::closeUpvalues(Value *last) {
+        while (this->openUpvalues != nullptr && this->openUpvalues->location >= last) {
+            ObjUpvalue *upvalue = this->openUpvalues;
+            upvalue->closed = *upvalue->location;
+            upvalue->location = &upvalue->closed;
+            writeBarrier(upvalue, upvalue->closed);
+            this->openUpvalues = upvalue->next;
+        }
+    }
+
+    void VM::defineMethod(ObjString *name) {
+        Value method = peek(0);
+        ObjClass *klass = AS_CLASS(peek(1));
+        klass->methods->set(name, method);
+        writeBarrier(klass, method);
+        klass->version++;
+        pop();
+    }
+
+    void VM::concatenate() {
+        Obj *b = AS_OBJ(peek(0));
+        Obj *a = AS_OBJ(peek(1));
+
+        // 短结果驻留 长结果追加到共享缓冲区
+        Obj *result = appendString(a, b);
+
+        pop();
+        pop();
+
+        push(OBJ_VAL(result));
+    }
+
+    InterpretResult VM::run() {
+        // 拿到vm中的栈帧
+        CallFrame *frame = &this->frames[this->frameCount - 1];
+
+// 读取字节码块单个字节
+#define READ_BYTE() (*frame->ip++)
+// 读取常量，在读取单个字节后再读取单个字节的值为常量数组的索引
+#define READ_SHORT() (frame->ip += 2, (uint16_t)((frame->ip[-2] << 8) | frame->ip[-1]))
+// 读取常量，在读取单个字节后再读取单个字节的值为常量数组的索引
+#define READ_CONSTANT() \
+    (frame->closure->function->chunk->constants[READ_BYTE()])
+// 读取常量后 转化为值字符串
+#define READ_STRING() AS_STRING(READ_CONSTANT())
+// 读取两个字节的内联缓存索引
+#define READ_CACHE() (&frame->closure->function->chunk->caches[READ_SHORT()])
+// 模拟二元运算 操作数是数字时把指令改写为数字特化指令
+#define BINARY_OP(valueType, op, quickened) \
+    do { \
+      if (!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1))) { \
+        runtimeError("Operands must be numbers."); \
+        return InterpretResult::RUNTIME_ERROR; \
+      } \
+      SPECIALIZE(quickened); \
+      double b = AS_NUMBER(pop()); \
+      double a = AS_NUMBER(pop()); \
+      push(valueType(a op b)); \
+    } while (false)
+
+// 数字特化的二元运算 不检查字符串 操作数不是数字时改回通用指令并重新执行这条指令
+#define NUMBER_OP(valueType, op, generic) \
+    do { \
+      Value b = peek(0); \
+      Value a = peek(1); \
+      if (IS_NUMBER(a) && IS_NUMBER(b)) { \
+        this->stackTop--; \
+        this->stackTop[-1] = valueType(AS_NUMBER(a) op AS_NUMBER(b)); \
+      } else { \
+        frame->ip[-1] = generic; \
+        frame->ip--; \
+        COUNT_DESPECIALIZATION(); \
+      } \
+    } while (false)
+
+// 比较两个数字后弹出 比较结果为false时跳转 与先比较再OP_JUMP_IF_FALSE一致 NaN时跳转
+#define COMPARE_JUMP(op) \
+    do { \
+      uint16_t offset = READ_SHORT(); \
+      Value b = peek(0); \
+      Value a = peek(1); \
+      if (!IS_NUMBER(a) || !IS_NUMBER(b)) { \
+        runtimeError("Operands must be numbers."); \
+        return InterpretResult::RUNTIME_ERROR; \
+      } \
+      this->stackTop -= 2; \
+      if (!(AS_NUMBER(a) op AS_NUMBER(b))) frame->ip += offset; \
+    } while (false)
+
+// 改写刚读取的操作码
+#define SPECIALIZE(quickened) \
+    do { \
+      frame->ip[-1] = quickened; \
+      COUNT_SPECIALIZATION(); \
+    } while (false)
+
+// 安全点 新生代满时回收新生代 或推进增量回收 回收会移动对象 之后不能再用之前取出的对象指针
+// 开启采样分析时也在这里记录调用栈
+#define SAFEPOINT() \
+    do { \
+      if (this->profileTick && this->profiler != nullptr) this->profiler->sample(this); \
+      if (this->nurseryPending || this->bytesAllocated >= this->nextSlice) gcSafepoint(); \
+    } while (false)
+
+// 当前帧的函数已编译时转入机器码 机器码在需要解释器执行的指令处返回
+#ifdef JIT
+#define JIT_ENTER() \
+    do { \
+      if (frame->closure->function->jit != nullptr) jitEnter(this, frame); \
+    } while (false)
+#else
+#define JIT_ENTER() do {} while (false)
+#endif
+
+// 开启寄存器层时从帧的ip处转入寄存器代码 返回时栈顶帧可能已经换了
+#define REGISTER_ENTER() \
+    do { \
+      if (this->registerEnabled) { \
+        if (!runRegisters()) return InterpretResult::RUNTIME_ERROR; \
+        frame = &this->frames[this->frameCount - 1]; \
+      } \
+    } while (false)
+
+// debug 轨迹 执行 打印虚拟机栈的内容并反汇编当前指令
+#ifdef DEBUG_TRACE_EXECUTION
+#define TRACE_EXECUTION() \
+    do { \
+      printf("          "); \
+      for (Value *slot = this->stack; slot < this->stackTop; slot++) { \
+        printf("[ "); \
+        slot->print(); \
+        printf(" ]"); \
+      } \
+      printf("\n"); \
+      disassembleInstruction(frame->closure->function->chunk, \
+          (int) (frame->ip - frame->closure->function->chunk->code.data())); \
+    } while (false)
+#else
+#define TRACE_EXECUTION() do {} while (false)
+#endif
+
+// 统计即将执行的指令 上一条指令的周期数到这里结束
+#ifdef DEBUG_OPCODE_STATS
+#define COUNT_OPCODE() countOpcode(&this->opcodeStats, *frame->ip)
+#define COUNT_SPECIALIZATION() (this->opcodeStats.specializations++)
+#define COUNT_DESPECIALIZATION() (this->opcodeStats.despecializations++)
+#else
+#define COUNT_OPCODE() do {} while (false)
+#define COUNT_SPECIALIZATION() do {} while (false)
+#define COUNT_DESPECIALIZATION() do {} while (false)
+#endif
+
+#ifdef COMPUTED_GOTO
+        // 线程化分派跳转表 下标为操作码 顺序必须与OpCode一致
+        static void *dispatchTable[] = {
+                [OP_CONSTANT]       = &&TARGET_OP_CONSTANT,
+                [OP_NIL]            = &&TARGET_OP_NIL,
+                [OP_TRUE]           = &&TARGET_OP_TRUE,
+                [OP_FALSE]          = &&TARGET_OP_FALSE,
+                [OP_POP]            = &&TARGET_OP_POP,
+                [OP_GET_LOCAL]      = &&TARGET_OP_GET_LOCAL,
+                [OP_SET_LOCAL]      = &&TARGET_OP_SET_LOCAL,
+                [OP_GET_GLOBAL]     = &&TARGET_OP_GET_GLOBAL,
+                [OP_DEFINE_GLOBAL]  = &&TARGET_OP_DEFINE_GLOBAL,
+                [OP_SET_GLOBAL]     = &&TARGET_OP_SET_GLOBAL,
+                [OP_GET_UPVALUE]    = &&TARGET_OP_GET_UPVALUE,
+                [OP_SET_UPVALUE]    = &&TARGET_OP_SET_UPVALUE,
+                [OP_GET_PROPERTY]   = &&TARGET_OP_GET_PROPERTY,
+                [OP_SET_PROPERTY]   = &&TARGET_OP_SET_PROPERTY,
+                [OP_GET_SUPER]      = &&TARGET_OP_GET_SUPER,
+                [OP_EQUAL]          = &&TARGET_OP_EQUAL,
+                [OP_GREATER]        = &&TARGET_OP_GREATER,
+                [OP_LESS]           = &&TARGET_OP_LESS,
+                [OP_ADD]            = &&TARGET_OP_ADD,
+                [OP_SUBTRACT]       = &&TARGET_OP_SUBTRACT,
+                [OP_MULTIPLY]       = &&TARGET_OP_MULTIPLY,
+                [OP_DIVIDE]         = &&TARGET_OP_DIVIDE,
+                [OP_NOT]            = &&TARGET_OP_NOT,
+                [OP_NEGATE]         = &&TARGET_OP_NEGATE,
+                [OP_PRINT]          = &&TARGET_OP_PRINT,
+                [OP_JUMP]           = &&TARGET_OP_JUMP,
+                [OP_JUMP_IF_FALSE]  = &&TARGET_OP_JUMP_IF_FALSE,
+                [OP_LOOP]           = &&TARGET_OP_LOOP,
+                [OP_CALL]           = &&TARGET_OP_CALL,
+                [OP_TAIL_CALL]      = &&TARGET_OP_TAIL_CALL,
+                [OP_INVOKE]         = &&TARGET_OP_INVOKE,
+                [OP_SUPER_INVOKE]   = &&TARGET_OP_SUPER_INVOKE,
+                [OP_CLOSURE]        = &&TARGET_OP_CLOSURE,
+                [OP_CLOSE_UPVALUE]  = &&TARGET_OP_CLOSE_UPVALUE,
+                [OP_RETURN]         = &&TARGET_OP_RETURN,
+                [OP_CLASS]          = &&TARGET_OP_CLASS,
+                [OP_INHERIT]        = &&TARGET_OP_INHERIT,
+                [OP_METHOD]         = &&TARGET_OP_METHOD,
+                [OP_ADD_NUMBER]      = &&TARGET_OP_ADD_NUMBER,
+                [OP_SUBTRACT_NUMBER] = &&TARGET_OP_SUBTRACT_NUMBER,
+                [OP_MULTIPLY_NUMBER] = &&TARGET_OP_MULTIPLY_NUMBER,
+                [OP_DIVIDE_NUMBER]   = &&TARGET_OP_DIVIDE_NUMBER,
+                [OP_GREATER_NUMBER]  = &&TARGET_OP_GREATER_NUMBER,
+                [OP_LESS_NUMBER]     = &&TARGET_OP_LESS_NUMBER,
+                [OP_POP_JUMP_IF_FALSE]     = &&TARGET_OP_POP_JUMP_IF_FALSE,
+                [OP_EQUAL_JUMP_IF_FALSE]   = &&TARGET_OP_EQUAL_JUMP_IF_FALSE,
+                [OP_GREATER_JUMP_IF_FALSE] = &&TARGET_OP_GREATER_JUMP_IF_FALSE,
+                [OP_LESS_JUMP_IF_FALSE]    = &&TARGET_OP_LESS_JUMP_IF_FALSE,
+                [OP_GET_LOCAL_PROPERTY]    = &&TARGET_OP_GET_LOCAL_PROPERTY,
+                [OP_ADD_LOCAL_CONSTANT]    = &&TARGET_OP_ADD_LOCAL_CONSTANT,
+        };
+// 每条指令末尾直接跳到下一条指令的处理代码 不再回到switch
+#define CASE(op) TARGET_##op:
+#define DISPATCH() \
+    do { \
+      TRACE_EXECUTION(); \
+      COUNT_OPCODE(); \
+      goto *dispatchTable[READ_BYTE()]; \
+    } while (false)
+#else
+#define CASE(op) case op:
+#define DISPATCH() break
+#endif
+
+        JIT_ENTER();
+        REGISTER_ENTER();
+#ifdef COMPUTED_GOTO
+        DISPATCH();
+        {
+            {
+#else
+        for (;;) {
+            TRACE_EXECUTION();
+            COUNT_OPCODE();
+            switch (READ_BYTE()) {
+#endif
+                CASE(OP_CONSTANT) {
+                    Value constant = READ_CONSTANT();
+                    push(constant);
+                    DISPATCH();
+                }
+                CASE(OP_NIL)
+                    push(NIL_VAL);
+                    DISPATCH();
+                CASE(OP_TRUE)
+                    push(BOOL_VAL(true));
+                    DISPATCH();
+                CASE(OP_FALSE)
+                    push(BOOL_VAL(false));
+                    DISPATCH();
+                CASE(OP_POP)
+                    pop();
+                    DISPATCH();
+                CASE(OP_GET_LOCAL) {
+                    uint8_t slot = READ_BYTE();
+                    push(frame->slots[slot]);
+                    DISPATCH();
+                }
+                CASE(OP_SET_LOCAL) {
+                    uint8_t slot = READ_BYTE();
+                    frame->slots[slot] = peek(0);
+                    DISPATCH();
+                }
+                CASE(OP_GET_GLOBAL) {
+                    uint16_t slot = READ_SHORT();
+                    Value value = this->globals[slot];
+                    if (IS_UNDEFINED(value)) {
+                        runtimeError("Undefined variable '%s'.", globalName(slot)->chars);
+                        return InterpretResult::RUNTIME_ERROR;
+                    }
+                    push(value);
+                    DISPATCH();
+                }
+                CASE(OP_DEFINE_GLOBAL) {
+                    uint16_t slot = READ_SHORT();
+                    this->globals[slot] = peek(0);
+                    pop();
+                    DISPATCH();
+                }
+                CASE(OP_SET_GLOBAL) {
+                    uint16_t slot = READ_SHORT();
+                    // 槽位未定义说明变量未定义 不写入
+                    if (IS_UNDEFINED(this->globals[slot])) {
+                        runtimeError("Undefined variable '%s'.", globalName(slot)->chars);
+                        return InterpretResult::RUNTIME_ERROR;
+                    }
+                    this->globals[slot] = peek(0);
+                    DISPATCH();
+                }
+                CASE(OP_GET_UPVALUE) {
+                    uint8_t slot = READ_BYTE();
+                    push(*frame->closure->upvalues[slot]->location);
+                    DISPATCH();
+                }
+                CASE(OP_SET_UPVALUE) {
+                    uint8_t slot = READ_BYTE();
+                    ObjUpvalue *upvalue = frame->closure->upvalues[slot];
+                    *upvalue->location = peek(0);
+                    writeBarrier(upvalue, peek(0));
+                    DISPATCH();
+                }
+                CASE(OP_GET_PROPERTY) {
+                    if (!IS_INSTANCE(peek(0))) {
+                        runtimeError("Only instances have properties.");
+                        return InterpretResult::RUNTIME_ERROR;
+                    }
+
+                    ObjInstance *instance = AS_INSTANCE(peek(0));
+                    ObjString *name = READ_STRING();
+                    InlineCache *cache = READ_CACHE();
+
+                    Value value;
+                    bool isField;
+                    if (!findProperty(instance, name, cache, &value, &isField)) {
+                        runtimeError("Undefined property '%s'.", name->chars);
+                        return InterpretResult::RUNTIME_ERROR;
+                    }
+
+                    if (isField) {
+                        pop(); // Instance.
+                        push(value);
+                    } else {
+                        ObjBoundMethod *bound = newBoundMethod(peek(0), AS_CLOSURE(value));
+                        pop();
+                        push(OBJ_VAL(bound));
+                    }
+                    DISPATCH();
+                }
+                CASE(OP_GET_LOCAL_PROPERTY) {
+                    Value receiver = frame->slots[READ_BYTE()];
+                    if (!IS_INSTANCE(receiver)) {
+                        runtimeError("Only instances have properties.");
+                        return InterpretResult::RUNTIME_ERROR;
+                    }
+
+                    ObjInstance *instance = AS_INSTANCE(receiver);
+                    ObjString *name = READ_STRING();
+                    InlineCache *cache = READ_CACHE();
+
+                    Value value;
+                    bool isField;
+                    if (!findProperty(instance, name, cache, &value, &isField)) {
+                        runtimeError("Undefined property '%s'.", name->chars);
+                        return InterpretResult::RUNTIME_ERROR;
+                    }
+
+                    // 接收者在局部变量槽位中 分配绑定方法时仍然可达
+                    if (isField) {
+                        push(value);
+                    } else {
+                        push(OBJ_VAL(newBoundMethod(receiver, AS_CLOSURE(value))));
+                    }
+                    DISPATCH();
+                }
+                CASE(OP_SET_PROPERTY) {
+                    if (!IS_INSTANCE(peek(1))) {
+                        runtimeError("Only instances have fields.");
+                        return InterpretResult::RUNTIME_ERROR;
+                    }
+
+                    ObjInstance *instance = AS_INSTANCE(peek(1));
+                    ObjString *name = READ_STRING();
+                    setProperty(instance, name, peek(0), READ_CACHE());
+                    Value value = pop();
+                    pop();
+                    push(value);
+                    DISPATCH();
+                }
+                CASE(OP_GET_SUPER) {
+                    ObjString *name = READ_STRING();
+                    InlineCache *cache = READ_CACHE();
+                    ObjClass *superclass = AS_CLASS(pop());
+
+                    if (!bindMethod(superclass, name, cache)) {
+                        return InterpretResult::RUNTIME_ERROR;
+                    }
+                    DISPATCH();
+                }
+                CASE(OP_EQUAL) {
+                    Value b = pop();
+                    Value a = pop();
+                    push(BOOL_VAL((a == b)));
+                    DISPATCH();
+                }
+                CASE(OP_GREATER)
+                    BINARY_OP(BOOL_VAL, >, OP_GREATER_NUMBER);
+                    DISPATCH();
+                CASE(OP_LESS)
+                    BINARY_OP(BOOL_VAL, <, OP_LESS_NUMBER);
+                    DISPATCH();
+                CASE(OP_ADD) {
+                    if (IS_ANY_STRING(peek(0)) && IS_ANY_STRING(peek(1))) {
+                        concatenate();
+                    } else if (IS_NUMBER(peek(0)) && IS_NUMBER(peek(1))) {
+                        SPECIALIZE(OP_ADD_NUMBER);
+                        double b = AS_NUMBER(pop());
+                        double a = AS_NUMBER(pop());
+                        push(NUMBER_VAL(a + b));
+                    } else {
+                        runtimeError(
+                                "Operands must be two numbers or two strings.");
+                        return InterpretResult::RUNTIME_ERROR;
+                    }
+                    DISPATCH();
+                }
+                CASE(OP_SUBTRACT)
+                    BINARY_OP(NUMBER_VAL, -, OP_SUBTRACT_NUMBER);
+                    DISPATCH();
+                CASE(OP_MULTIPLY)
+                    BINARY_OP(NUMBER_VAL, *, OP_MULTIPLY_NUMBER);
+                    DISPATCH();
+                CASE(OP_DIVIDE)
+                    BINARY_OP(NUMBER_VAL, /, OP_DIVIDE_NUMBER);
+                    DISPATCH();
+                CASE(OP_ADD_NUMBER)
+                    NUMBER_OP(NUMBER_VAL, +, OP_ADD);
+                    DISPATCH();
+                CASE(OP_SUBTRACT_NUMBER)
+                    NUMBER_OP(NUMBER_VAL, -, OP_SUBTRACT);
+                    DISPATCH();
+                CASE(OP_MULTIPLY_NUMBER)
+                    NUMBER_OP(NUMBER_VAL, *, OP_MULTIPLY);
+                    DISPATCH();
+                CASE(OP_DIVIDE_NUMBER)
+                    NUMBER_OP(NUMBER_VAL, /, OP_DIVIDE);
+                    DISPATCH();
+                CASE(OP_GREATER_NUMBER)
+                    NUMBER_OP(BOOL_VAL, >, OP_GREATER);
+                    DISPATCH();
+                CASE(OP_LESS_NUMBER)
+                    NUMBER_OP(BOOL_VAL, <, OP_LESS);
+                    DISPATCH();
+                CASE(OP_NOT)
+                    push(BOOL_VAL(isFalsey(pop())));
+                    DISPATCH();
+                CASE(OP_NEGATE)
+                    if (!IS_NUMBER(peek(0))) {
+                        runtimeError("Operand must be a number.");
+                        return InterpretResult::RUNTIME_ERROR;
+                    }
+                    push(NUMBER_VAL(-AS_NUMBER(pop())));
+                    DISPATCH();
+                CASE(OP_PRINT) {
+                    pop().print();
+                    printf("\n");
+                    DISPATCH();
+                }
+                CASE(OP_JUMP) {
+                    uint16_t offset = READ_SHORT();
+                    frame->ip += offset;
+                    DISPATCH();
+                }
+                CASE(OP_JUMP_IF_FALSE) {
+                    uint16_t offset = READ_SHORT();
+                    if (isFalsey(peek(0))) frame->ip += offset;
+                    DISPATCH();
+                }
+                CASE(OP_POP_JUMP_IF_FALSE) {
+                    uint16_t offset = READ_SHORT();
+                    if (isFalsey(pop())) frame->ip += offset;
+                    DISPATCH();
+                }
+                CASE(OP_EQUAL_JUMP_IF_FALSE) {
+                    uint16_t offset = READ_SHORT();
+                    Value b = pop();
+                    Value a = pop();
+                    if (!(a == b)) frame->ip += offset;
+                    DISPATCH();
+                }
+                CASE(OP_GREATER_JUMP_IF_FALSE)
+                    COMPARE_JUMP(>);
+                    DISPATCH();
+                CASE(OP_LESS_JUMP_IF_FALSE)
+                    COMPARE_JUMP(<);
+                    DISPATCH();
+                CASE(OP_ADD_LOCAL_CONSTANT) {
+                    Value *slot = &frame->slots[READ_BYTE()];
+                    Value constant = READ_CONSTANT();
+                    Value value = *slot;
+                    if (!IS_NUMBER(value)) {
+                        runtimeError("Operands must be two numbers or two strings.");
+                        return InterpretResult::RUNTIME_ERROR;
+                    }
+                    *slot = NUMBER_VAL(AS_NUMBER(value) + AS_NUMBER(constant));
+                    DISPATCH();
+                }
+                CASE(OP_LOOP) {
+                    uint16_t offset = READ_SHORT();
+                    SAFEPOINT();
+                    frame->ip -= offset;
+                    heatUp(this, frame->closure->function);
+                    JIT_ENTER();
+                    REGISTER_ENTER();
+                    DISPATCH();
+                }
+                CASE(OP_CALL) {
+                    SAFEPOINT();
+                    int argCount = READ_BYTE();
+                    if (!callValue(peek(argCount), argCount)) {
+                        return InterpretResult::RUNTIME_ERROR;
+                    }
+                    // 调用成功后将栈帧还回去
+                    frame = &this->frames[this->frameCount - 1];
+                    JIT_ENTER();
+                    REGISTER_ENTER();
+                    DISPATCH();
+                }
+                CASE(OP_TAIL_CALL) {
+                    SAFEPOINT();
+                    int argCount = READ_BYTE();
+                    if (!tailCall(peek(argCount), argCount)) {
+                        return InterpretResult::RUNTIME_ERROR;
+                    }
+                    frame = &this->frames[this->frameCount - 1];
+                    JIT_ENTER();
+                    REGISTER_ENTER();
+                    DISPATCH();
+                }
+                CASE(OP_INVOKE) {
+                    SAFEPOINT();
+                    ObjString *method = READ_STRING();
+                    int argCount = READ_BYTE();
+                    InlineCache *cache = READ_CACHE();
+                    if (!invoke(method, argCount, cache)) {
+                        return InterpretResult::RUNTIME_ERROR;
+                    }
+                    frame = &this->frames[this->frameCount - 1];
+                    JIT_ENTER();
+                    REGISTER_ENTER();
+                    DISPATCH();
+                }
+                CASE(OP_SUPER_INVOKE) {
+                    SAFEPOINT();
+                    ObjString *method = READ_STRING();
+                    int argCount = READ_BYTE();
+                    InlineCache *cache = READ_CACHE();
+                    ObjClass *superclass = AS_CLASS(pop());
+                    if (!invokeFromClass(superclass, method, argCount, cache)) {
+                        return InterpretResult::RUNTIME_ERROR;
+                    }
+                    frame = &this->frames[this->frameCount - 1];
+                    JIT_ENTER();
+                    REGISTER_ENTER();
+                    DISPATCH();
+                }
+                CASE(OP_CLOSURE) {
+                    ObjFunction *function = AS_FUNCTION(READ_CONSTANT());
+                    ObjClosure *closure = newClosure(function);
+                    push(OBJ_VAL(closure));
+                    for (int i = 0; i < closure->upvalueCount; i++) {
+                        uint8_t isLocal = READ_BYTE();
+                        uint8_t index = READ_BYTE();
+                        if (isLocal) {
+                            closure->upvalues[i] = captureUpvalue(frame->slots + index);
+                        } else {
+                            closure->upvalues[i] = frame->closure->upvalues[index];
+                        }
+                    }
+                    DISPATCH();
+                }
+                CASE(OP_CLOSE_UPVALUE)
+                    closeUpvalues(this->stackTop - 1);
+                    pop();
+                    DISPATCH();
+                CASE(OP_RETURN) {
+                    SAFEPOINT();
+                    Value result = pop();
+                    closeUpvalues(frame->slots);
+                    this->frameCount--;
+                    if (this->frameCount == 0) {
+                        pop();
+                        return InterpretResult::OK;
+                    }
+
+                    this->stackTop = frame->slots;
+                    push(result);
+                    frame = &this->frames[this->frameCount - 1];
+                    JIT_ENTER();
+                    REGISTER_ENTER();
+                    DISPATCH();
+                }
+                CASE(OP_CLASS)
+                    push(OBJ_VAL(newClass(READ_STRING())));
+                    DISPATCH();
+                CASE(OP_INHERIT) {
+                    Value superclass = peek(1);
+                    if (!IS_CLASS(superclass)) {
+                        runtimeError("Superclass must be a class.");
+                        return InterpretResult::RUNTIME_ERROR;
+                    }
+
+                    ObjClass *subclass = AS_CLASS(peek(0));
+
+                    subclass->methods->addAll(AS_CLASS(superclass)->methods);
+                    rememberObject(subclass);
+                    writeBarrier(subclass, superclass);
+                    subclass->version++;
+
+                    pop(); // Subclass.
+                    DISPATCH();
+                }
+                CASE(OP_METHOD)
+                    defineMethod(READ_STRING());
+                    DISPATCH();
+            }
+        }
+
+#undef READ_BYTE
+#undef READ_SHORT
+#undef READ_CONSTANT
+#undef READ_STRING
+#undef READ_CACHE
+#undef BINARY_OP
+#undef NUMBER_OP
+#undef SPECIALIZE
+#undef COMPARE_JUMP
+#undef SAFEPOINT
+#undef JIT_ENTER
+#undef REGISTER_ENTER
+#undef TRACE_EXECUTION
+#undef COUNT_OPCODE
+#undef COUNT_SPECIALIZATION
+#undef COUNT_DESPECIALIZATION
+#undef CASE
+#undef DISPATCH
+    }
+}
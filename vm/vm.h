@@ -5,17 +5,50 @@
 #ifndef CPPLOX_VM_H
 #define CPPLOX_VM_H
 
+#include <csignal>
 #include <cstdio>
 
 #include "object.h"
+#include "pool.h"
 #include "value.h"
 
 
 namespace cpplox {
 
-    // 栈数组最大值
-    const size_t FRAMES_MAX = 64;
-    const size_t STACK_MAX = (FRAMES_MAX * UINT8_COUNT);
+    class Profiler;
+
+    // 调用帧数组初始容量和默认上限 超过上限报栈溢出
+    const int FRAMES_INITIAL = 8;
+    const int FRAMES_MAX = 1 << 18;
+    // 虚拟机栈初始容量和默认上限 单位为值
+    const size_t STACK_INITIAL = 2 * UINT8_COUNT;
+    const size_t STACK_MAX = 1 << 24;
+    // 调用时保证栈顶之上至少有这么多空位 局部变量最多256个 其余留给临时值
+    const size_t STACK_FRAME_RESERVE = 2 * UINT8_COUNT;
+
+    // 新生代大小
+    const size_t NURSERY_SIZE = 1024 * 1024;
+
+    // 老年代回收阶段
+    enum class GcPhase {
+        IDLE,             // 未在回收
+        MARK,             // 增量标记中
+        SWEEP             // 增量清扫中
+    };
+
+#ifdef DEBUG_OPCODE_STATS
+    // 操作码执行统计 退出时输出
+    struct OpcodeStats {
+        uint64_t counts[OPCODE_COUNT];                  // 各操作码执行次数
+        uint64_t pairs[OPCODE_COUNT][OPCODE_COUNT];     // [前一条][后一条]相邻执行的次数
+        uint64_t cycles[OPCODE_COUNT];                  // 各操作码消耗的时钟周期 只在DEBUG_OPCODE_CYCLES下统计
+        uint64_t specializations;                       // 通用指令改写为数字特化指令的次数
+        uint64_t despecializations;                     // 特化指令遇到非数字改回通用指令的次数
+        uint64_t registerInstructions;                  // 寄存器层执行的指令数 不计入上面的操作码统计
+        int previous;                                   // 上一条执行的操作码 还没有时为-1
+        uint64_t start;                                 // 上一条指令开始时的时间戳
+    };
+#endif
 
     enum class InterpretResult {
         OK,               // 解释执行成功
@@ -32,16 +65,27 @@ namespace cpplox {
 
 // 虚拟机
     class VM {
+        friend class JitRuntime;
+
     public:
-        CallFrame frames[FRAMES_MAX];   // 栈帧数组 所有函数调用的执行点
+        CallFrame *frames;              // 栈帧数组 所有函数调用的执行点 按需扩容
         int frameCount;                 // 当前调用栈数
+        int frameCapacity;              // 栈帧数组容量
+        int framesMax;                  // 栈帧数上限
 
-        Value stack[STACK_MAX];         // 虚拟机栈
+        Value *stack;                   // 虚拟机栈 扩容时会移动 指向栈的指针随之修正
         Value *stackTop;                // 栈顶指针 总是指向栈顶
-        Table globals;                  // 全局变量表
+        size_t stackCapacity;           // 虚拟机栈容量
+        size_t stackMax;                // 虚拟机栈容量上限
+        Pool pool;                      // 小块内存池 老年代对象和小数组从中分配 在表之后析构
+        Table globalNames;              // 全局变量名到槽位下标的映射 编译时分配槽位
+        Value *globals;                 // 全局变量槽位 未定义的为UNDEFINED_VAL
+        int globalCount;                // 全局变量槽位数量
+        int globalCapacity;             // 全局变量槽位容量
         Table strings;                  // 全局字符串表
         ObjString *initString;          // 构造器名称
         ObjUpvalue *openUpvalues;       // 全局提升值
+        Shape *rootShape;               // 实例的初始空形状 形状转移树的根
 
         size_t bytesAllocated;          // 已经分配的内存
         size_t nextGC;                  // 出发下一次gc的阈值
@@ -50,17 +94,58 @@ namespace cpplox {
         int grayCount;                  // 灰色对象数量
         int grayCapacity;               // 灰色对象容量
         Obj **grayStack;                // 灰色对象栈
+        GcPhase gcPhase;                // 老年代回收阶段
+        Obj *sweepList;                 // 等待清扫的对象链表
+        size_t nextSlice;               // 增量回收时推进下一步的阈值
+        size_t gcPauseBudget;           // 增量回收每次暂停的预算 微秒 为0时一次完成回收
+
+        uint8_t *nursery;               // 新生代 新对象在其中碰撞分配
+        uint8_t *nurseryTop;            // 新生代中下一个对象的地址
+        uint8_t *nurseryEnd;            // 新生代末尾
+        bool nurseryPending;            // 在下一个安全点回收新生代
+        int rememberedCount;            // 记忆集数量
+        int rememberedCapacity;         // 记忆集容量
+        Obj **rememberedSet;            // 记忆集 可能引用新生代对象的老年代对象
+
+        size_t internHits;              // 驻留查找命中次数 已有相同字符串 没有分配
+        size_t internMisses;            // 驻留查找未命中次数 新建了字符串
+
+        bool jitEnabled;                // 是否把热点函数编译成机器码
+        uint32_t jitThreshold;          // 函数编译前的调用和循环回跳次数
+        bool registerEnabled;           // 是否把函数翻译成寄存器代码执行 开启时不用JIT
+
+#ifdef DEBUG_OPCODE_STATS
+        OpcodeStats opcodeStats;        // 操作码执行统计
+#endif
+
+        Profiler *profiler;             // 采样分析器 未开启时为nullptr
+        volatile sig_atomic_t profileTick; // 定时器信号置位 下一个安全点采样
 
         // 解释字节码块
         InterpretResult interpret(const char *source);
 
+        // 执行编译好的脚本函数 用于字节码缓存
+        InterpretResult interpret(ObjFunction *function);
+
         void push(Value value);
 
         Value pop();
 
         void resetStack();
 
-        void defineNative(const std::string& name, NativeFn function);
+        void defineNative(const char *name, NativeFn function);
+
+        // 全局变量的槽位下标 第一次出现的名字分配一个未定义的槽位
+        int globalSlot(ObjString *name);
+
+        // 槽位对应的全局变量名
+        ObjString *globalName(int slot);
+
+        // 释放count之后分配的槽位 编译期丢弃执行不到的代码时回滚其中新出现的名字
+        void truncateGlobals(int count);
+
+        // 设置栈和栈帧数组的初始容量与上限 只能在没有执行代码时调用
+        void configureStack(size_t stackInitial, size_t stackLimit, int framesInitial, int framesLimit);
 
     private:
         void runtimeError(const char *format, ...);
@@ -69,13 +154,25 @@ namespace cpplox {
 
         bool call(ObjClosure *closure, int argCount);
 
+        bool growFrames();
+
+        bool growStack(size_t needed);
+
         bool callValue(Value callee, int argCount);
 
-        bool invokeFromClass(ObjClass *klass, ObjString *name, int argCount);
+        bool tailCall(Value callee, int argCount);
 
-        bool invoke(ObjString *name, int argCount);
+        bool findMethod(ObjClass *klass, ObjString *name, InlineCache *cache, Value *method);
 
-        bool bindMethod(ObjClass *klass, ObjString *name);
+        bool findProperty(ObjInstance *instance, ObjString *name, InlineCache *cache, Value *value, bool *isField);
+
+        void setProperty(ObjInstance *instance, ObjString *name, Value value, InlineCache *cache);
+
+        bool invokeFromClass(ObjClass *klass, ObjString *name, int argCount, InlineCache *cache);
+
+        bool invoke(ObjString *name, int argCount, InlineCache *cache);
+
+        bool bindMethod(ObjClass *klass, ObjString *name, InlineCache *cache);
 
         ObjUpvalue *captureUpvalue(Value *local);
 
@@ -86,15 +183,19 @@ namespace cpplox {
         void concatenate();
 
         InterpretResult run();
+
+        bool runRegisters();
     };
 
-    extern VM vm;
+    // 当前线程使用的虚拟机 分配器 编译器和gc通过它找到所属的堆
+    // 每个线程各自运行自己的虚拟机 虚拟机之间不共享对象
+    extern thread_local VM *vm;
 
-    // 初始化虚拟机啊
-    void initVM();
+    // 初始化虚拟机啊 并设为当前线程的虚拟机
+    void initVM(VM *instance);
 
     // 释放虚拟机
-    void freeVM();
+    void freeVM(VM *instance);
 
 }
 